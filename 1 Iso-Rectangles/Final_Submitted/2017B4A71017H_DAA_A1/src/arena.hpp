@@ -0,0 +1,62 @@
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <utility>
+
+/**
+ * Bump allocator handing out objects of type T from large blocks.
+ * Objects are never freed one by one; reset() rewinds the whole arena
+ * at once and keeps the blocks around for the next computation.
+ */
+template <class T>
+class Arena
+{
+    static const int _BLOCK_SIZE = 4096; ///< Number of objects per block.
+    std::vector<std::unique_ptr<T[]>> blocks; ///< Blocks owned by the arena.
+    size_t block = 0; ///< Index of the block currently being filled.
+    int pos = 0; ///< Next free slot in the current block.
+    long long count = 0; ///< Objects handed out since the last reset.
+
+public:
+    /**
+     * Constructs a new object in the arena.
+     * @param[in] args arguments forwarded to the constructor of T.
+     * @return pointer to the object, valid until the next reset().
+     */
+    template <class... Args>
+    T* make(Args&&... args)
+    {
+        if(pos == _BLOCK_SIZE)
+            ++block, pos = 0;
+        if(block == blocks.size())
+            blocks.emplace_back(new T[_BLOCK_SIZE]);
+        T* out = &blocks[block][pos++];
+        *out = T(std::forward<Args>(args)...);
+        ++count;
+        return out;
+    }
+
+    /**
+     * Releases every object in bulk. The blocks are kept for reuse.
+     */
+    void reset()
+    {
+        block = 0, pos = 0, count = 0;
+    }
+
+    /**
+     * @return number of objects allocated since the last reset().
+     */
+    long long allocations() const
+    {
+        return count;
+    }
+
+    /**
+     * @return number of bytes of objects allocated since the last reset().
+     */
+    size_t bytes() const
+    {
+        return size_t(count) * sizeof(T);
+    }
+};
@@ -0,0 +1,208 @@
+#include <tuple>
+#include <cmath>
+#include <algorithm>
+#include "guting.hpp"
+#include "profile.hpp"
+
+/**
+ * Decides whether the bitmap engine can take a set of rectangles: all the
+ * coordinates must be integers, each side of the bounding box must be at
+ * most #_MAX_SIDE cells and the grid, whose rows take whole words, must
+ * fit in #bitmap_cells. When asked for, the bitmap engine must also be
+ * estimated cheaper than the divide and conquer engine. Rasterizing costs
+ * one pass over the words of the grid, #_ROW_WORDS more per row for the
+ * runs and contour edges of that row, and the words set by each rectangle;
+ * the divide and conquer engine is taken to cost #_DAC_WORDS such words per
+ * n log n. A few large rectangles thus stay with the divide and conquer
+ * engine however small their grid is.
+ * @param[in] rs indicates the rectangles, with x_left < x_right and y_bot < y_top.
+ * @param[in] n indicates the number of rectangles.
+ * @param[in] cheaper indicates whether the bitmap engine must also be the
+ * cheaper one.
+ * @return whether rectangle_bitmap() may be used.
+ */
+template <class T>
+bool Guting<T>::rasterizable(const Rectangle* rs, int n, bool cheaper)
+{
+    if(n == 0 or bitmap_cells <= 0)
+        return false;
+    T x0 = rs[0].x_left, x1 = rs[0].x_right, y0 = rs[0].y_bot, y1 = rs[0].y_top;
+    for(int i = 0; i < n; ++i)
+    {
+        const Rectangle& r = rs[i];
+        for(T c : {r.x_left, r.x_right, r.y_bot, r.y_top})
+            if(std::floor(c) != c)
+                return false;
+        x0 = std::min(x0, r.x_left), x1 = std::max(x1, r.x_right);
+        y0 = std::min(y0, r.y_bot), y1 = std::max(y1, r.y_top);
+    }
+    Len w = Len(x1) - x0, h = Len(y1) - y0;
+    if(w > _MAX_SIDE or h > _MAX_SIDE)
+        return false;
+    long long rows = (long long)h + 1, words = (long long)w/64 + 1; // As rectangle_bitmap() lays out the grid.
+    if(rows * words > bitmap_cells / 64)
+        return false;
+    if(not cheaper)
+        return true;
+    double work = double(rows) * (words + _ROW_WORDS);
+    for(int i = 0; i < n; ++i)
+        work += double(Len(rs[i].y_top) - rs[i].y_bot) * ((long long)(Len(rs[i].x_right) - rs[i].x_left)/64 + 1);
+    return work <= _DAC_WORDS * n * std::log2(n + 1.0);
+}
+
+/**
+ * Appends the runs of set bits of a row mask, as [start, end) pairs.
+ * @param[in] m indicates the mask, whose bit past the last one is clear.
+ * @param[in] words indicates the number of words of m.
+ * @param[out] runs receives the runs, in increasing order.
+ */
+template <class T>
+void Guting<T>::runs(const uint64_t* m, int words, std::vector<std::tuple<int, int>>& runs)
+{
+    int start = 0;
+    bool open = false;
+    uint64_t carry = 0;
+    for(int w = 0; w < words; ++w)
+    {
+        uint64_t t = m[w] ^ (m[w] << 1 | carry);
+        carry = m[w] >> 63;
+        while(t)
+        {
+            int x = 64*w + __builtin_ctzll(t);
+            t &= t - 1;
+            if(open)
+                runs.push_back({start, x});
+            else
+                start = x;
+            open = not open;
+        }
+    }
+}
+
+/**
+ * Computes the union on a grid of unit cells spanning the bounding box,
+ * with one bitset per row. Each rectangle sets its cells with whole-word
+ * operations; the measure is the number of set cells, the horizontal
+ * contour the number of cells that differ from the cell below them and the
+ * vertical contour the number that differ from the cell on their left.
+ * The contour edges are the maximal runs of such cells along which the
+ * covered side does not change, reported in the order find_contour() uses.
+ * Takes O(H*W/64) words for a bounding box of W by H cells, plus the words
+ * set by each rectangle.
+ * @param[in] rs indicates the rectangles, which rasterizable() accepts.
+ * @param[in] nr indicates the number of rectangles.
+ * @param[out] edges receives the edges of the contour, unless it is nullptr.
+ * @param[in] with_contour indicates whether the contour is computed. If not,
+ * the contour is reported as 0.
+ * @return Measure and Contour of the set of rectangles.
+ */
+template <class T>
+std::tuple<typename Guting<T>::Area, typename Guting<T>::Area> Guting<T>::rectangle_bitmap(
+    const Rectangle* rs,
+    int nr,
+    std::vector<ContourEdge>* edges,
+    bool with_contour
+)
+{
+    PROFILE_SCOPE("bitmap");
+    T x0 = rs[0].x_left, x1 = rs[0].x_right, y0 = rs[0].y_bot, y1 = rs[0].y_top;
+    for(int i = 0; i < nr; ++i)
+    {
+        x0 = std::min(x0, rs[i].x_left), x1 = std::max(x1, rs[i].x_right);
+        y0 = std::min(y0, rs[i].y_bot), y1 = std::max(y1, rs[i].y_top);
+    }
+    // rasterizable() keeps both sides within _MAX_SIDE, so every cell position fits in an int.
+    int width = int(Len(x1) - x0), height = int(Len(y1) - y0);
+    int words = width/64 + 1; // Leaves room for the boundary at x = width.
+    std::vector<uint64_t> grid(size_t(height + 1) * words, 0); // Row height stays clear.
+    for(int i = 0; i < nr; ++i)
+    {
+        const Rectangle& r = rs[i];
+        int a = int(Len(r.x_left) - x0), b = int(Len(r.x_right) - x0);
+        int wa = a/64, wb = (b - 1)/64;
+        uint64_t ma = ~0ull << (a % 64), mb = ~0ull >> (63 - (b - 1) % 64);
+        int top = int(Len(r.y_top) - y0);
+        for(int y = int(Len(r.y_bot) - y0); y < top; ++y)
+        {
+            uint64_t* row = &grid.at(size_t(y) * words);
+            if(wa == wb)
+                row[wa] |= ma & mb;
+            else
+            {
+                row[wa] |= ma;
+                std::fill(row + wa + 1, row + wb, ~0ull);
+                row[wb] |= mb;
+            }
+        }
+    }
+
+    Area msr = 0, ctr = 0;
+    std::vector<uint64_t> below(words, 0), up(words), down(words), left(words), right(words);
+    std::vector<uint64_t> was_left(words, 0), was_right(words, 0);
+    std::vector<int> start_left(width + 1), start_right(width + 1);
+    std::vector<std::tuple<int, int>> ups, downs;
+    std::vector<std::tuple<int, int, int>> vertical; // (x, y_bot, y_top) of each vertical edge.
+
+    // Closes the vertical runs that end at row y and opens those that start there.
+    auto track = [&](std::vector<uint64_t>& was, std::vector<uint64_t>& now, std::vector<int>& start, int y){
+        for(int w = 0; w < words; ++w)
+        {
+            for(uint64_t t = was[w] ^ now[w]; t; t &= t - 1)
+            {
+                int x = 64*w + __builtin_ctzll(t);
+                if(now[w] >> (x % 64) & 1)
+                    start.at(x) = y;
+                else
+                    vertical.push_back({x, start.at(x), y});
+            }
+            was[w] = now[w];
+        }
+    };
+
+    for(int y = 0; y <= height; ++y)
+    {
+        const uint64_t* row = &grid.at(size_t(y) * words);
+        uint64_t carry = 0;
+        for(int w = 0; w < words; ++w)
+        {
+            uint64_t shifted = row[w] << 1 | carry;
+            carry = row[w] >> 63;
+            up[w] = below[w] & ~row[w], down[w] = row[w] & ~below[w];
+            left[w] = row[w] & ~shifted, right[w] = shifted & ~row[w];
+            msr += __builtin_popcountll(row[w]);
+            if(with_contour)
+                ctr += __builtin_popcountll(below[w] ^ row[w]) + __builtin_popcountll(row[w] ^ shifted);
+        }
+        if(edges and with_contour)
+        {
+            ups.clear(), downs.clear();
+            runs(up.data(), words, ups);
+            runs(down.data(), words, downs);
+            std::vector<std::tuple<int, int>> all(ups.size() + downs.size());
+            std::merge(ups.begin(), ups.end(), downs.begin(), downs.end(), all.begin());
+            for(auto [a, b] : all)
+                edges->emplace_back(ContourEdge(T(x0 + a), T(y0 + y), b - a, 0));
+            track(was_left, left, start_left, y);
+            track(was_right, right, start_right, y);
+        }
+        std::copy(row, row + words, below.begin());
+    }
+    if(edges and with_contour)
+    {
+        std::sort(vertical.begin(), vertical.end());
+        for(auto [x, a, b] : vertical)
+            edges->emplace_back(ContourEdge(T(x0 + x), T(y0 + a), 0, b - a));
+    }
+    return {msr, ctr};
+}
+
+// guting.cpp instantiates Guting itself, which only covers the members defined
+// there; the members defined here are instantiated one by one.
+#define INSTANTIATE(U) \
+    template bool Guting<U>::rasterizable(const Rectangle*, int, bool); \
+    template void Guting<U>::runs(const uint64_t*, int, std::vector<std::tuple<int, int>>&); \
+    template std::tuple<Guting<U>::Area, Guting<U>::Area> Guting<U>::rectangle_bitmap(const Rectangle*, int, std::vector<ContourEdge>*, bool);
+INSTANTIATE(int32_t)
+INSTANTIATE(int64_t)
+INSTANTIATE(double)
+#undef INSTANTIATE
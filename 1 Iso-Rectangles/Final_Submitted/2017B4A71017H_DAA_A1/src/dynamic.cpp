@@ -0,0 +1,253 @@
+#include <tuple>
+#include <cmath>
+#include <algorithm>
+#include "guting.hpp"
+
+/**
+ * Builds the index over #rects and computes their measure with the
+ * sweep line. Called on the first insert() or erase().
+ */
+template <class T>
+void Guting<T>::build_index()
+{
+    rebuild();
+    measure = std::get<0>(rectangle_sweep(rects.data(), int(rects.size())));
+    indexed = true;
+}
+
+/**
+ * Sorts #rects by x_left into blocks of about sqrt(n) rectangles. Edits
+ * split blocks that grow past twice that and drop empty ones, and the
+ * blocks are rebuilt whenever the set has doubled or halved since, so
+ * there are O(sqrt(n)) blocks of O(sqrt(n)) rectangles.
+ */
+template <class T>
+void Guting<T>::rebuild()
+{
+    int n = int(rects.size());
+    std::vector<int> order(n);
+    for(int i = 0; i < n; ++i)
+        order.at(i) = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b){
+        return rects.at(a).x_left < rects.at(b).x_left;
+    });
+    block_size = std::max(int(_MIN_BLOCK), int(std::sqrt(double(n))));
+    built = n;
+    blocks.clear();
+    for(int i = 0; i < n; i += block_size)
+    {
+        blocks.emplace_back();
+        blocks.back().ids.assign(order.begin() + i, order.begin() + std::min(n, i + block_size));
+        refresh(blocks.back());
+    }
+}
+
+/**
+ * Recomputes the reach of a nonempty block.
+ * @param[in,out] b indicates the block.
+ */
+template <class T>
+void Guting<T>::refresh(Block& b)
+{
+    b.reach = rects.at(b.ids.front()).x_right;
+    for(int id : b.ids)
+        b.reach = std::max(b.reach, rects.at(id).x_right);
+}
+
+/**
+ * Finds a rectangle in #blocks. Rectangles with the same x_left may span
+ * several blocks, which are searched in turn.
+ * @param[in] r indicates the rectangle.
+ * @param[in] id indicates its position in #rects, or -1 for any rectangle
+ * equal to r.
+ * @return the block and the position in it, or (-1, -1) if not found.
+ */
+template <class T>
+std::tuple<int, int> Guting<T>::locate(const Rectangle& r, int id)
+{
+    auto left = [&](int i){ return rects.at(i).x_left; };
+    int nb = int(blocks.size());
+    int b = int(std::partition_point(blocks.begin(), blocks.end(), [&](const Block& bl){
+        return left(bl.ids.back()) < r.x_left;
+    }) - blocks.begin());
+    for(; b < nb and left(blocks.at(b).ids.front()) <= r.x_left; ++b)
+    {
+        const std::vector<int>& ids = blocks.at(b).ids;
+        auto it = std::partition_point(ids.begin(), ids.end(), [&](int i){ return left(i) < r.x_left; });
+        for(; it != ids.end() and left(*it) == r.x_left; ++it)
+        {
+            const Rectangle& c = rects.at(*it);
+            if(id >= 0 ? *it == id : (c.x_right == r.x_right and c.y_bot == r.y_bot and c.y_top == r.y_top))
+                return {b, int(it - ids.begin())};
+        }
+    }
+    return {-1, -1};
+}
+
+/**
+ * Calculates the area of q that is covered by the other rectangles.
+ * Blocks are walked by x_left until they start past q; those whose reach
+ * ends before q are skipped whole, and the sweep runs over the parts
+ * inside q of the rectangles of the others. This looks at O(sqrt(n))
+ * blocks plus the rectangles of the blocks that reach into q.
+ * @param[in] q indicates the rectangle.
+ * @param[in] skip indicates the position of q in #rects, or -1 if q is
+ * not in #rects.
+ * @return area of the union of the other rectangles inside q.
+ */
+template <class T>
+typename Guting<T>::Area Guting<T>::covered(Rectangle q, int skip)
+{
+    std::vector<Rectangle> clip;
+    for(const Block& b : blocks)
+    {
+        if(rects.at(b.ids.front()).x_left >= q.x_right)
+            break;
+        if(b.reach <= q.x_left)
+            continue;
+        for(int id : b.ids)
+        {
+            Rectangle& r = rects.at(id);
+            if(r.x_left >= q.x_right)
+                break;
+            if(id == skip)
+                continue;
+            T xl = std::max(r.x_left, q.x_left), xr = std::min(r.x_right, q.x_right);
+            T yb = std::max(r.y_bot, q.y_bot), yt = std::min(r.y_top, q.y_top);
+            if(xl < xr and yb < yt)
+                clip.emplace_back(Rectangle(xl, xr, yb, yt));
+        }
+    }
+    return std::get<0>(rectangle_sweep(clip.data(), int(clip.size())));
+}
+
+/**
+ * Adds a rectangle to the set and updates #measure by the area it adds
+ * to the union. Takes O(sqrt(n) + k log k) for k rectangles in the blocks
+ * near the new one instead of recomputing the whole set. #contour is
+ * updated lazily by get_contour().
+ * @param[in] xl indicates the x_left of the rectangle.
+ * @param[in] xr indicates the x_right of the rectangle.
+ * @param[in] yb indicates the y_bot of the rectangle.
+ * @param[in] yt indicates the y_top of the rectangle.
+ */
+template <class T>
+void Guting<T>::insert(T xl, T xr, T yb, T yt)
+{
+    if(xl == xr or yb == yt)
+        return;
+    if(xl > xr)
+        std::swap(xl, xr);
+    if(yb > yt)
+        std::swap(yb, yt);
+    if(not indexed)
+        build_index();
+    Rectangle rect(xl, xr, yb, yt);
+    measure += Area(Len(xr) - xl) * (Len(yt) - yb) - covered(rect, -1);
+    int id = int(rects.size());
+    rects.emplace_back(rect);
+    stale = true;
+    if(blocks.empty())
+    {
+        blocks.emplace_back();
+        blocks.back().ids.push_back(id);
+        refresh(blocks.back());
+        return;
+    }
+    auto left = [&](int i){ return rects.at(i).x_left; };
+    int b = int(std::partition_point(blocks.begin(), blocks.end(), [&](const Block& bl){
+        return left(bl.ids.front()) <= xl;
+    }) - blocks.begin());
+    Block& block = blocks.at(std::max(b - 1, 0));
+    std::vector<int>& ids = block.ids;
+    ids.insert(std::partition_point(ids.begin(), ids.end(), [&](int i){ return left(i) <= xl; }), id);
+    block.reach = std::max(block.reach, xr);
+    if(int(rects.size()) >= 2 * built)
+        rebuild();
+    else if(int(ids.size()) > 2 * block_size)
+    {
+        Block upper;
+        upper.ids.assign(ids.begin() + block_size, ids.end());
+        ids.resize(block_size);
+        refresh(block), refresh(upper);
+        blocks.insert(blocks.begin() + std::max(b - 1, 0) + 1, std::move(upper));
+    }
+}
+
+/**
+ * Removes one copy of a rectangle from the set and updates #measure by
+ * the area only it covered. The reach of its block is recomputed, so a
+ * wide rectangle stops slowing covered() down once it is gone. #contour
+ * is updated lazily by get_contour().
+ * @param[in] xl indicates the x_left of the rectangle.
+ * @param[in] xr indicates the x_right of the rectangle.
+ * @param[in] yb indicates the y_bot of the rectangle.
+ * @param[in] yt indicates the y_top of the rectangle.
+ * @return whether the rectangle was found.
+ */
+template <class T>
+bool Guting<T>::erase(T xl, T xr, T yb, T yt)
+{
+    if(xl > xr)
+        std::swap(xl, xr);
+    if(yb > yt)
+        std::swap(yb, yt);
+    if(not indexed)
+        build_index();
+    auto [b, k] = locate(Rectangle(xl, xr, yb, yt), -1);
+    if(b < 0)
+        return false;
+
+    Block& block = blocks.at(b);
+    int i = block.ids.at(k), back = int(rects.size()) - 1;
+    measure -= Area(Len(xr) - xl) * (Len(yt) - yb) - covered(rects.at(i), i);
+    block.ids.erase(block.ids.begin() + k);
+    if(block.ids.empty())
+        blocks.erase(blocks.begin() + b);
+    else
+        refresh(block);
+    if(i != back)
+    {
+        auto [bb, bk] = locate(rects.at(back), back);
+        blocks.at(bb).ids.at(bk) = i;
+        rects.at(i) = rects.at(back);
+    }
+    rects.pop_back();
+    stale = true;
+    if(2 * int(rects.size()) <= built)
+        rebuild();
+    return true;
+}
+
+/**
+ * Recomputes #contour with the selected engine if the set has changed
+ * since it was last computed.
+ * @return the contour of the current set of rectangles.
+ */
+template <class T>
+typename Guting<T>::Area Guting<T>::get_contour()
+{
+    if(stale)
+    {
+        Area msr;
+        std::tie(msr, contour) = run(rects.data(), int(rects.size()));
+        stale = false;
+    }
+    return contour;
+}
+
+// guting.cpp instantiates Guting itself, which only covers the members defined
+// there; the members defined here are instantiated one by one.
+#define INSTANTIATE(U) \
+    template void Guting<U>::build_index(); \
+    template void Guting<U>::rebuild(); \
+    template void Guting<U>::refresh(Block&); \
+    template std::tuple<int, int> Guting<U>::locate(const Rectangle&, int); \
+    template Guting<U>::Area Guting<U>::covered(Rectangle, int); \
+    template void Guting<U>::insert(U, U, U, U); \
+    template bool Guting<U>::erase(U, U, U, U); \
+    template Guting<U>::Area Guting<U>::get_contour();
+INSTANTIATE(int32_t)
+INSTANTIATE(int64_t)
+INSTANTIATE(double)
+#undef INSTANTIATE
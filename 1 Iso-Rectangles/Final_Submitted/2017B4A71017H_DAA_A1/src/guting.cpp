@@ -1,16 +1,37 @@
-#include <set>
 #include <tuple>
 #include <algorithm>
 #include <fstream>
 #include "guting.hpp"
 #include "io.hpp"
+#include "rectfile.hpp"
+#include "profile.hpp"
+
+/**
+ * @return index of the calling thread, used to pick its
+ * arena and scratch buffers.
+ */
+template <class T>
+int Guting<T>::thread() const
+{
+    return workers ? workers->index() : 0;
+}
+
+/**
+ * @return the arena of the calling thread.
+ */
+template <class T>
+Arena<typename Guting<T>::CTree>& Guting<T>::pool()
+{
+    return pools.at(thread());
+}
 
 /**
  * Calculates the partition of y-projections contained in vy.
  * @param[in] vy indicates the y-projections of endpoints of edges.
  * @returns the vector of interval denoting the partition of vy.
  */
-std::vector<Guting::Interval> Guting::partitions(std::vector<double>& vy)
+template <class T>
+std::vector<typename Guting<T>::Interval> Guting<T>::partitions(std::vector<T>& vy)
 {
     std::vector<Interval> out;
     int n = int(vy.size());
@@ -24,18 +45,20 @@ std::vector<Guting::Interval> Guting::partitions(std::vector<double>& vy)
  * @param[in] s indicates the vector of stripes whose y partition is
  * to be updated.
  * @param[in] p denotes y projections of the frame.
- * @param[in] frame indicates the entire frame of the merge step.
- * @returns the vector of stripe after copying.
+ * @param[out] sc receives the stripes after copying. Its previous
+ * contents are discarded but its capacity is reused.
  */
-std::vector<Guting::Stripe> Guting::copy(
+template <class T>
+void Guting<T>::copy(
     std::vector<Stripe>& s,
-    std::vector<double>& p,
-    Interval frame
+    std::vector<T>& p,
+    std::vector<Stripe>& sc
 )
 {
-    std::vector<Stripe> sc;
-    for(Interval intr : partitions(p))
-        sc.emplace_back(Stripe(frame, intr, 0, new CTree()));
+    sc.clear();
+    int n = int(p.size());
+    for(int i = 1; i < n; ++i)
+        sc.emplace_back(Stripe(Interval(p.at(i-1), p.at(i)), 0, &empty));
     auto it = s.begin();
     auto jt = sc.begin();
     while(it != s.end() and jt != sc.end())
@@ -45,36 +68,32 @@ std::vector<Guting::Stripe> Guting::copy(
         else
             ++it;
     }
-    return sc;
 }
 
 /**
  * Blackens the stripes vs based on the edges in ve, meaning their
  * x union fields are updated to indicate that they are completely 
- * covered by a rectangle.
+ * covered by a rectangle. Both the stripes and the edges come sorted by
+ * y-interval, so one pass keeping the highest top of the edges starting
+ * below each stripe finds the covered ones.
  * @param[in] vs indicates the vector of stripes to be blackened.
  * @param[in] ve indicates the vector of edges based on which we blacken vs.
+ * @param[in] from indicates the first edge of ve to be used.
+ * @param[in] to indicates one past the last edge of ve to be used.
+ * @param[in] width indicates the width of the frame of vs.
  */
-void Guting::blacken(std::vector<Stripe>& vs, std::vector<Edge>& ve)
+template <class T>
+void Guting<T>::blacken(std::vector<Stripe>& vs, std::vector<Edge>& ve, int from, int to, Len width)
 {
-    int n = int(vs.size());
-    std::vector<std::tuple<Interval, int>> vii;
-    std::vector<Interval> vi;
-    for(int i = 0; i < n; i++)
-        vii.push_back({vs.at(i).y_intr, i});
-    for(Edge e : ve)
-        vi.emplace_back(e.intr);
-    std::sort(vii.begin(), vii.end());
-    std::sort(vi.begin(), vi.end());
-    std::set<double> ss;
-    auto it = vi.begin();
-    for(auto [intr, ia] : vii)
+    PROFILE_SCOPE("blacken");
+    T reach = -INF;
+    int i = from;
+    for(Stripe& stripe : vs)
     {
-        while(it != vi.end() and it->bot <= intr.bot)
-            ss.insert(it->top), ++it;
-        auto jt = ss.lower_bound(intr.top);
-        if(jt != ss.end())
-            vs.at(ia).measure = vs.at(ia).x_intr.width(), vs.at(ia).ctree = new CTree();
+        while(i < to and ve.at(i).intr.bot <= stripe.y_intr.bot)
+            reach = std::max(reach, ve.at(i).intr.top), ++i;
+        if(reach >= stripe.y_intr.top)
+            stripe.measure = width, stripe.ctree = &empty;
     }
 }
 
@@ -85,129 +104,183 @@ void Guting::blacken(std::vector<Stripe>& vs, std::vector<Edge>& ve)
  * @param[in] sr indicates the stripes of the right frame.
  * @param[in] p indicates the y-projections of all endpoints
  * of vertical edges in the entire frame.
- * @param[in] frame indicates the x-interval of the entire frame,
- * that is the left and right frame.
- * @return the concatenated stripe of the merged frame.
+ * @param[in] xm indicates the x-coordinate at which the left
+ * and right frames meet.
+ * @param[out] out receives the concatenated stripe of the merged frame.
+ * Its previous contents are discarded but its capacity is reused.
  */
-std::vector<Guting::Stripe> Guting::concat(
+template <class T>
+void Guting<T>::concat(
     std::vector<Stripe>& sl,
     std::vector<Stripe>& sr,
-    std::vector<double>& p,
-    Interval frame
+    std::vector<T>& p,
+    T xm,
+    std::vector<Stripe>& out
 )
 {
-    std::vector<Stripe> out;
-    for(Interval intr : partitions(p))
-        out.emplace_back(Stripe(frame, intr, 0, new CTree()));
+    PROFILE_SCOPE("concat");
+    out.clear();
+    int n = int(p.size());
+    for(int i = 1; i < n; ++i)
+        out.emplace_back(Stripe(Interval(p.at(i-1), p.at(i)), 0, &empty));
     for(int i = 0; i < int(sl.size()); ++i)
     {
-        auto s1 = sl.at(i), s2 = sr.at(i);
+        auto &s1 = sl.at(i), &s2 = sr.at(i);
         auto& sout = out.at(i);
         sout.measure = s1.measure + s2.measure;
-        if(s1.ctree and s2.ctree)
-            sout.ctree = new CTree(s1.x_intr.top, RT, s1.ctree, s2.ctree);
-        else if(s1.ctree and not s2.ctree)
+        if(not trees)
+            continue;
+        if(s1.ctree != &empty and s2.ctree != &empty)
+            sout.ctree = pool().make(xm, RT, s1.ctree, s2.ctree);
+        else if(s1.ctree != &empty)
             sout.ctree = s1.ctree;
-        else if(not s1.ctree and s2.ctree)
-            sout.ctree = s2.ctree;
         else
-            sout.ctree = new CTree();
+            sout.ctree = s2.ctree;
     }
-    return out;
 }
 
 /**
  * The merge step of divide and conquer algorithm. It merges the
  * two frames and gives the L, R, P and S value for the combined frame.
+ * The buffers of in1 are reused for the result, so both inputs
+ * are consumed.
  * @param[in] in1 indicates the L, R, P, S value of the left frame.
  * @param[in] in2 indicates the L, R, P, S value of the right frame.
  * @param[in] frame indicates the x-interval of the merged frame.
  * @param[in] xm indicates the median value of the x-coordinates of 
  * the edges of the frame.
+ * @param[in] lo indicates the first edge of the merged frame.
+ * @param[in] hi indicates one past the last edge of the merged frame.
+ * @param[in] depth indicates the depth of the merged frame in the recursion.
  * @return a tuple of L, R, P and S for the merged frame.
  */
-Guting::LRPS Guting::merge(LRPS in1, LRPS in2, Interval frame, double xm)
+template <class T>
+typename Guting<T>::LRPS Guting<T>::merge(LRPS& in1, LRPS& in2, Interval frame, T xm, int lo, int hi, int depth)
 {
+    PROFILE_SCOPE("merge");
     auto& [l1, r1, p1, s1] = in1;
     auto& [l2, r2, p2, s2] = in2;
-    LRPS out;
-    auto& [l, r, p, s] = out;
-    std::vector<Edge> l1c, r2c;
+    auto& own = scratch.at(thread());
+    if(int(own.size()) <= depth)
+        own.resize(depth + 1);
+    Scratch& buf = own.at(depth);
+    auto &pu = buf.p, &eu = buf.e;
+    auto &sl = buf.sl, &sr = buf.sr;
+    auto by_y = [](const Edge& a, const Edge& b){ return a.intr < b.intr; };
 
-    for(Edge e : l1)
-        if (e.xp > frame.top)
-            l1c.emplace_back(e);
-    l.insert(l.end(), l1c.begin(), l1c.end());
-    l.insert(l.end(), l2.begin(), l2.end());
+    // l1c keeps the left edges whose partner is outside the frame.
+    // Partners are found by position, as with integer coordinates xm may
+    // coincide with an edge and the x-coordinates cannot tell the frames apart.
+    l1.erase(
+        std::remove_if(l1.begin(), l1.end(), [&](const Edge& e){ return e.partner < hi; }),
+        l1.end()
+    );
 
-    for(Edge e : r2)
-        if (e.xp < frame.bot)
-            r2c.emplace_back(e);
-    r.insert(r.end(), r1.begin(), r1.end());
-    r.insert(r.end(), r2c.begin(), r2c.end());
+    // r2c keeps the right edges whose partner is outside the frame.
+    r2.erase(
+        std::remove_if(r2.begin(), r2.end(), [&](const Edge& e){ return e.partner >= lo; }),
+        r2.end()
+    );
 
-    std::set_union(p1.begin(), p1.end(), p2.begin(), p2.end(), std::back_inserter(p));
-    std::vector<Stripe> sl = copy(s1, p, Interval(frame.bot, xm));
-    std::vector<Stripe> sr = copy(s2, p, Interval(xm, frame.top));
+    pu.clear();
+    std::set_union(p1.begin(), p1.end(), p2.begin(), p2.end(), std::back_inserter(pu));
+    std::swap(p1, pu);
+    copy(s1, p1, sl);
+    copy(s2, p1, sr);
 
-    blacken(sl, r2c);
-    blacken(sr, l1c);
-    s = concat(sl, sr, p, frame);
+    blacken(sl, r2, 0, int(r2.size()), Len(xm) - frame.bot);
+    blacken(sr, l1, 0, int(l1.size()), Len(frame.top) - xm);
+    concat(sl, sr, p1, xm, s1);
 
-    return out;
+    // L = l1c + l2 and R = r1 + r2c, merged to stay sorted by y-interval.
+    eu.clear();
+    std::merge(l1.begin(), l1.end(), l2.begin(), l2.end(), std::back_inserter(eu), by_y);
+    std::swap(l1, eu);
+    eu.clear();
+    std::merge(r1.begin(), r1.end(), r2.begin(), r2.end(), std::back_inserter(eu), by_y);
+    std::swap(r1, eu);
+
+    return {std::move(l1), std::move(r1), std::move(p1), std::move(s1)};
+}
+
+/**
+ * @param[in] ve represents the sorted set of vertical edges of the rectangles.
+ * @param[in] i indicates a position in ve.
+ * @return the x-coordinate at which a frame ending before ve[i] meets a
+ * frame starting at ve[i], or -INF and INF at either end of ve.
+ */
+template <class T>
+T Guting<T>::boundary(std::vector<Edge>& ve, int i)
+{
+    if(i <= 0)
+        return -INF;
+    if(i >= int(ve.size()))
+        return INF;
+    return Coord<T>::mid(ve.at(i-1).xc, ve.at(i).xc);
+}
+
+/**
+ * Computes L, R, P and S for a frame holding a single edge.
+ * @param[in] e indicates the edge.
+ * @param[in] frame indicates the x-interval of the frame.
+ * @param[out] out receives L, R, P and S for the frame, as described in
+ * stripes(). Its previous contents are discarded but its capacity is reused.
+ */
+template <class T>
+void Guting<T>::base(const Edge& e, Interval frame, LRPS& out)
+{
+    auto& [l, r, p, s] = out;
+    l.clear(), r.clear(), s.clear();
+    if(e.side == LEFT)
+        l.push_back(e);
+    else
+        r.push_back(e);
+    p = {-INF, e.intr.bot, e.intr.top, INF};
+    s.emplace_back(Stripe(Interval(-INF, e.intr.bot), 0, &empty));
+    if(e.side == LEFT)
+        s.emplace_back(Stripe(e.intr, Len(frame.top) - e.xc, trees ? pool().make(e.xc, LC) : &empty));
+    else
+        s.emplace_back(Stripe(e.intr, Len(e.xc) - frame.bot, trees ? pool().make(e.xc, RC) : &empty));
+    s.emplace_back(Stripe(Interval(e.intr.top, INF), 0, &empty));
 }
 
 /**
  * This is the main divide and conquer algorithm using recursion.
- * @param[in] ve represents the set of vertical edges of the rectangles.
+ * @param[in] ve represents the sorted set of vertical edges of the rectangles.
+ * @param[in] lo indicates the first edge of ve in the current frame.
+ * @param[in] hi indicates one past the last edge of ve in the current frame.
  * @param[in] frame represents the current x interval we are considering,
- * it encloses the x-coordinates of all the edges in ve.
+ * it encloses the x-coordinates of all the edges in ve[lo, hi).
+ * @param[in] depth indicates the depth of the current frame in the recursion.
  * @return L, R, P and S for the current frame.
- * L contains those left edges of ve whose partner is not in frame.
+ * L contains those left edges of ve whose partner is not in frame,
+ * sorted by y-interval.
  * R is symmetric to L (for right edges).
  * P contains the y-projections of all endpoints of edges in V plus the
  * frame boundary in y-direction, namely -INF and INF.
  * S is the set of Stripes that will be required to calculate
  * measure and contour.
  */
-Guting::LRPS Guting::stripes(std::vector<Edge> ve, Interval frame)
+template <class T>
+typename Guting<T>::LRPS Guting<T>::stripes(std::vector<Edge>& ve, int lo, int hi, Interval frame, int depth)
 {
+    PROFILE_SCOPE("stripes");
     LRPS out;
-    auto& [l, r, p, s] = out;
-    if(ve.size() == 1)
-    {
-        Edge e = ve.front();
-        if(e.side == LEFT)
-            l = std::vector<Edge>(1, e);
-        else
-            r = std::vector<Edge>(1, e);
-        p = {-INF, e.intr.bot, e.intr.top, INF};
-        for(Interval intr : partitions(p))
-        {
-            if(intr == e.intr)
-            {
-                if(e.side == LEFT)
-                    s.emplace_back(Stripe(frame, intr, frame.top - e.xc, new CTree(e.xc, LC)));
-                else
-                    s.emplace_back(Stripe(frame, intr, e.xc - frame.bot, new CTree(e.xc, RC)));
-            }
-            else
-                s.emplace_back(Stripe(frame, intr, 0, new CTree()));
-        }
-    }
+    if(hi - lo == 1)
+        base(ve.at(lo), frame, out);
     else
     {
-        int n = int(ve.size());
+        int n = hi - lo;
         int mid = n/2 - 1, median;
-        auto& midedge = ve.at(mid);
-        if(ve.front().xc == ve.back().xc or ve.at(mid).xc != ve.at(mid+1).xc)
+        auto& midedge = ve.at(lo + mid);
+        if(ve.at(lo).xc == ve.at(hi-1).xc or ve.at(lo + mid).xc != ve.at(lo + mid+1).xc)
             median = mid+1;
         else
         {
             int c1 = 0;
             for(int i = mid; i >= 1; --i)
             {
-                if(ve.at(i).xc == midedge.xc)
+                if(ve.at(lo + i).xc == midedge.xc)
                     ++c1;
                 else
                     break;
@@ -215,7 +288,7 @@ Guting::LRPS Guting::stripes(std::vector<Edge> ve, Interval frame)
             int c2 = 0;
             for(int i = mid+1; i+1 < n; ++i)
             {
-                if(ve.at(i).xc == midedge.xc)
+                if(ve.at(lo + i).xc == midedge.xc)
                     ++c2;
                 else
                     break;
@@ -226,28 +299,129 @@ Guting::LRPS Guting::stripes(std::vector<Edge> ve, Interval frame)
             int t4 = n - t3;
             int ch1 = abs(t1 - t2);
             int ch2 = abs(t3 - t4);
-            if(ve.back().xc == midedge.xc)
+            if(ve.at(hi-1).xc == midedge.xc)
                 median = t3;
-            else if(ve.front().xc == midedge.xc)
+            else if(ve.at(lo).xc == midedge.xc)
                 median = t1;
             else if(ch1 <= ch2)
                 median = t1;
             else
                 median = t3;
         }
-        std::vector<Edge> v1(ve.begin(), ve.begin() + median);
-        std::vector<Edge> v2(ve.begin() + median, ve.end());
-        double xm = (v1.back().xc + v2.front().xc)/2;
-        out = merge(
-            stripes(v1, Interval(frame.bot, xm)),
-            stripes(v2, Interval(xm, frame.top)),
-            frame,
-            xm
-        );
+        T xm = boundary(ve, lo + median);
+        LRPS left, right;
+        if(workers and n >= cutoff)
+        {
+            ThreadPool::Task task([&]{
+                right = stripes(ve, lo + median, hi, Interval(xm, frame.top), depth+1);
+            });
+            workers->spawn(task);
+            left = stripes(ve, lo, lo + median, Interval(frame.bot, xm), depth+1);
+            workers->wait(task);
+        }
+        else
+        {
+            left = stripes(ve, lo, lo + median, Interval(frame.bot, xm), depth+1);
+            right = stripes(ve, lo + median, hi, Interval(xm, frame.top), depth+1);
+        }
+        out = merge(left, right, frame, xm, lo, hi, depth);
     }
     return out;
 }
 
+/**
+ * Bottom-up form of stripes() over the edges ve[lo, hi), without recursion.
+ * The edges are taken in order as frames of one edge, and the two newest
+ * frames are merged as long as they hold the same number of edges, so the
+ * frames waiting to be merged hold 2^k edges for decreasing k and at most
+ * one frame per level is alive. The frame of each level is kept in the
+ * scratch buffers of that level and reused by the next frame built there.
+ * Once all the edges are taken the waiting frames are merged from the right.
+ * Frames are cut by position, so a cut may fall inside a run of edges with
+ * the same x, which stripes() also does once a frame holds a single x. This
+ * gives the same result as cutting between runs: boundary() then returns
+ * that x, so each side still encloses its edges and one side may have no
+ * width, which adds 0 to every stripe measure; merge() pairs partners by
+ * position rather than by x; and concat() joins the contour trees at that
+ * x in edge order, as the tree of the whole run would hold them.
+ * @param[in] ve represents the sorted set of vertical edges of the rectangles.
+ * @param[in] lo indicates the first edge of ve to be used.
+ * @param[in] hi indicates one past the last edge of ve to be used.
+ * @return L, R, P and S for the frame of ve[lo, hi), as stripes() gives.
+ */
+template <class T>
+typename Guting<T>::LRPS Guting<T>::levels(std::vector<Edge>& ve, int lo, int hi)
+{
+    auto& own = scratch.at(thread());
+    std::vector<int> start; // First edge of the waiting frame of each level.
+    auto fold = [&](int end){
+        int d = int(start.size()) - 1;
+        int a = start.at(d-1), b = start.at(d);
+        auto& left = own.at(d-1).frame;
+        left = merge(left, own.at(d).frame, Interval(boundary(ve, a), boundary(ve, end)), boundary(ve, b), a, end, d-1);
+        start.pop_back();
+    };
+    for(int i = lo; i < hi; ++i)
+    {
+        int d = int(start.size());
+        if(int(own.size()) <= d)
+            own.resize(d + 1);
+        base(ve.at(i), Interval(boundary(ve, i), boundary(ve, i+1)), own.at(d).frame);
+        start.push_back(i);
+        while(start.size() > 1 and i+1 - start.back() == start.back() - start.end()[-2])
+            fold(i+1);
+    }
+    while(start.size() > 1)
+        fold(hi);
+    return std::move(own.at(0).frame);
+}
+
+/**
+ * Bottom-up engine. With several threads the edges are cut into one block
+ * per thread, each thread runs levels() on its block and the blocks are
+ * then merged pairwise, level by level. The blocks are cut by position,
+ * which is sound for the reasons given for the cuts inside levels().
+ * @param[in] ve represents the sorted set of vertical edges of the rectangles.
+ * @return L, R, P and S for the frame of all the edges, as stripes() gives.
+ */
+template <class T>
+typename Guting<T>::LRPS Guting<T>::levels(std::vector<Edge>& ve)
+{
+    PROFILE_SCOPE("levels");
+    int n = int(ve.size());
+    int parts = workers and n >= cutoff ? std::min(workers->size(), n) : 1;
+    std::vector<LRPS> out(parts);
+    std::vector<int> start(parts + 1);
+    for(int k = 0; k <= parts; ++k)
+        start.at(k) = int((long long)n * k / parts);
+
+    // Runs job(k) for every k in [0, count), spreading them over the threads.
+    auto spread = [&](int count, const std::function<void(int)>& job){
+        std::vector<std::unique_ptr<ThreadPool::Task>> tasks;
+        for(int k = 1; k < count; ++k)
+        {
+            tasks.emplace_back(new ThreadPool::Task([&, k]{ job(k); }));
+            workers->spawn(*tasks.back());
+        }
+        job(0);
+        for(auto& task : tasks)
+            workers->wait(*task);
+    };
+    if(parts == 1)
+        return levels(ve, 0, n);
+    spread(parts, [&](int k){ out.at(k) = levels(ve, start.at(k), start.at(k+1)); });
+    for(int width = 1; width < parts; width *= 2)
+    {
+        int pairs = (parts + width - 1)/(2*width);
+        spread(pairs, [&](int k){
+            int a = 2*k*width, b = a + width, c = std::min(b + width, parts);
+            int lo = start.at(a), mid = start.at(b), hi = start.at(c);
+            out.at(a) = merge(out.at(a), out.at(b), Interval(boundary(ve, lo), boundary(ve, hi)), boundary(ve, mid), lo, hi, 0);
+        });
+    }
+    return std::move(out.at(0));
+}
+
 /**
  * Calculates the measure of the given set of rectangles
  * using the set of stripes that we got using divide and conquer
@@ -255,12 +429,13 @@ Guting::LRPS Guting::stripes(std::vector<Edge> ve, Interval frame)
  * @param[in] stripes is the set of stripes obtained through divide and conquer.
  * @return measure of the rectangles.
  */
-double Guting::find_measure(std::vector<Stripe>& stripes)
+template <class T>
+typename Guting<T>::Area Guting<T>::find_measure(std::vector<Stripe>& stripes)
 {
-    double out = 0;
-    for(Stripe stripe : stripes)
+    Area out = 0;
+    for(Stripe& stripe : stripes)
         if(stripe.measure)
-            out += stripe.measure * stripe.y_intr.width();
+            out += Area(stripe.measure) * stripe.y_intr.width();
     return out;
 }
 
@@ -268,108 +443,118 @@ double Guting::find_measure(std::vector<Stripe>& stripes)
  * A utility DFS function for use by construct_leaf(). Stores
  * the leaf of the tree of a given stripe.
  * @param[in] tree on which we have to perform DFS.
+ * @param[out] leaf receives the x-coordinates of the leaves in order.
  */
-void Guting::dfs(CTree *tree)
+template <class T>
+void Guting<T>::dfs(CTree *tree, std::vector<T>& leaf)
 {
     if(not tree)
         return;
     if(tree->parity != RT)
         leaf.push_back(tree->x);
     CTree *ldaughter = tree->lson, *rdaughter = tree->rson;
-    dfs(ldaughter);
-    dfs(rdaughter);
+    dfs(ldaughter, leaf);
+    dfs(rdaughter, leaf);
 }
 
 /**
- * Constructs the leaf nodes for all the stripes.
- * @param[in] strips indicate the set of all the stripes obtained
- * using our divide and conquer algorithm.
+ * Appends the leaves of a stripe to #leaves, between the sentinels
+ * -INF and INF, and closes its row.
+ * @param[in] strip indicates the stripe.
  */
-void Guting::construct_leaf(std::vector<Stripe>& strips)
+template <class T>
+void Guting<T>::construct_leaf(Stripe& strip)
 {
-    for(Stripe& strp: strips)
-    {
-        leaf.clear();
-        leaf.emplace_back(-INF);
-        dfs(strp.ctree);
-        leaf.emplace_back(INF);
-        strp.leaf = leaf;
-    }
+    PROFILE_SCOPE("construct_leaf");
+    std::vector<T>& values = leaves.values;
+    values.emplace_back(-INF);
+    dfs(strip.ctree, values);
+    values.emplace_back(INF);
+    leaves.offsets.push_back(values.size());
 }
 
 /**
- * Answers the free subinterval query, that is subinterval of xi that are
- * free with respect to leaf.
- * @param[in] xi indicates the interval for which we have to answer the query.
- * @param[in] leaf indicates the leaf nodes of stripe used to answer find the
- * free subinterval.
- * @param[in] ycoord indicates the y-coordinate of the interval.
- * @param[in] flag indicates whether the interval for which we are answering
- * the query belongs to a bottom edge or a top edge of the rectangle.
+ * Answers the free subinterval queries of a run of horizontal edges lying
+ * on the same side of one stripe, that is the subintervals of each edge
+ * that are free with respect to the leaves of the stripe. The leaves pair
+ * up into the free x-intervals of the stripe in increasing order, and the
+ * edges come sorted by x_left, so one pass over both answers the run.
+ * @param[in] hrx indicates the horizontal edges.
+ * @param[in] from indicates the first edge of the run.
+ * @param[in] to indicates one past the last edge of the run.
+ * @param[in] lf indicates the first leaf of the stripe.
+ * @param[in] end indicates one past the last leaf of the stripe.
+ * @param[in] flag indicates whether the edges are bottom edges or top edges
+ * of the rectangles.
+ * @param[out] cont receives the free subintervals as horizontal contour pieces.
  */
-void Guting::query(Interval xi, std::vector<double>& lf, double ycoord, bool flag)
+template <class T>
+void Guting<T>::query(std::vector<Edge>& hrx, int from, int to, const T* lf, const T* end, bool flag, std::vector<HEdge>& cont)
 {
-    int n = int(lf.size());
-    int idx = int(lower_bound(lf.begin(), lf.end(), xi.bot) - lf.begin());   
-    if(idx % 2)
-        idx--;
-    for(int i = idx; i < n; i += 2)
+    for(int k = from; k < to; ++k)
     {
-        double& cur = lf.at(i);
-        double& nxt = lf.at(i+1);
-        if (not(idx % 2) and (cur >= xi.top))
-            break;
-        if(cur < nxt)
-        {
-            if(nxt <= xi.bot or cur >= xi.top)
-                continue;
-            cont.push_back({ycoord, std::max(cur, xi.bot), std::min(nxt, xi.top), flag});
-        }
+        Interval xi = hrx.at(k).intr;
+        T ycoord = hrx.at(k).xc;
+        while(lf != end and lf[1] <= xi.bot)
+            lf += 2;
+        for(const T* cur = lf; cur != end and *cur < xi.top; cur += 2)
+            if(cur[0] < cur[1])
+                cont.push_back({ycoord, std::max(cur[0], xi.bot), std::min(cur[1], xi.top), flag});
     }
 }
 
 /**
  * Calculates the contour of the given set of rectangles
  * using the set of stripes that we got using divide and conquer
- * algorithm.
+ * algorithm. The leaves of a stripe are only gathered when some
+ * horizontal edge lies on its boundary.
  * @param[in] strips is the set of stripes obtained through divide and conquer.
- * @param[in] hrx indicates the set of horizontal rectangle edges.
+ * @param[in] hrx indicates the set of horizontal rectangle edges, sorted by
+ * y-coordinate, side and x_left.
+ * @param[out] edges receives the edges of the contour, unless it is nullptr.
  * @return length of the contour.
  */
-double Guting::find_contour(std::vector<Stripe>& strips, std::vector<Edge>& hrx)
+template <class T>
+typename Guting<T>::Area Guting<T>::find_contour(
+    std::vector<Stripe>& strips,
+    std::vector<Edge>& hrx,
+    std::vector<ContourEdge>* edges
+)
 {
-    construct_leaf(strips);
-    double out = 0;
-    auto it = hrx.begin();
-    auto jt = strips.begin();
-    while(it != hrx.end() and jt != strips.end())
+    PROFILE_SCOPE("find_contour");
+    leaves.offsets.assign(1, 0);
+    leaves.values.clear();
+    std::vector<HEdge> cont;
+    int nh = int(hrx.size()), ns = int(strips.size());
+    int i = 0, j = 0, last = -1;
+    while(i < nh and j < ns)
     {
-        if(it->side == BOT)
-        {
-            if(jt->y_intr.top < it->xc)
-                ++jt;
-            else if(jt->y_intr.top == it->xc)
-                query(it->intr, jt->leaf, it->xc, 0), ++it;
-            else
-                ++it;
-        }
+        Edge& e = hrx.at(i);
+        T y = e.side == BOT ? strips.at(j).y_intr.top : strips.at(j).y_intr.bot;
+        if(y < e.xc)
+            ++j;
+        else if(y > e.xc)
+            ++i;
         else
         {
-            if(jt->y_intr.bot < it->xc)
-                ++jt;
-            else if(jt->y_intr.bot == it->xc)
-                query(it->intr, jt->leaf, it->xc, 1), ++it;
-            else
-                ++it;
+            int k = i;
+            while(k < nh and hrx.at(k).xc == e.xc and hrx.at(k).side == e.side)
+                ++k;
+            if(last != j)
+                construct_leaf(strips.at(j)), last = j;
+            size_t lo = leaves.offsets.end()[-2], hi = leaves.offsets.back();
+            const T* lf = leaves.values.data();
+            query(hrx, i, k, lf + lo, lf + hi, e.side == TOP, cont);
+            i = k;
         }
     }
-
-    std::ofstream file;
-    file.open("..\\output\\contour_edges.txt");
+    Area out = 0;
+    if(cont.empty())
+        return out;
 
     int n = int(cont.size());
     std::sort(cont.begin(), cont.end());
-    std::vector<std::tuple<double, double>> ep;
+    std::vector<std::tuple<T, T>> ep;
     
     auto& [y1, xl1, xr1, f1] = cont.front();
     for(auto& [y2, xl2, xr2, f2] : cont)
@@ -379,17 +564,19 @@ double Guting::find_contour(std::vector<Stripe>& strips, std::vector<Edge>& hrx)
             xr1 = std::max(xr1, xr2);
             continue;
         }
-        file << xl1 << ' ' << y1 << ' ' << xr1 - xl1 << ' ' << 0 << '\n';
+        if(edges)
+            edges->emplace_back(ContourEdge(xl1, y1, Len(xr1) - xl1, 0));
         ep.push_back({xl1, y1});
         ep.push_back({xr1, y1});
-        out += (xr1 - xl1);
+        out += Len(xr1) - xl1;
         y1 = y2, xl1 = xl2, xr1 = xr2, f1 = f2;
     }
 
-    file << xl1 << ' ' << y1 << ' ' << xr1 - xl1 << ' ' << 0 << '\n';
+    if(edges)
+        edges->emplace_back(ContourEdge(xl1, y1, Len(xr1) - xl1, 0));
     ep.push_back({xl1, y1});
     ep.push_back({xr1, y1});
-    out += (xr1 - xl1);
+    out += Len(xr1) - xl1;
     
     std::sort(ep.begin(), ep.end());
     n = int(ep.size());
@@ -403,56 +590,117 @@ double Guting::find_contour(std::vector<Stripe>& strips, std::vector<Edge>& hrx)
                 continue;
             else
             {
-                out += (ny - cy);
-                file << cx << ' ' << cy << ' ' << 0 << ' ' << ny - cy << '\n';
+                out += Len(ny) - cy;
+                if(edges)
+                    edges->emplace_back(ContourEdge(cx, cy, 0, Len(ny) - cy));
                 ++i;
             }
         }
     }
-    file.close();
     return out;
 }
 
 /**
- * Provides an algorithm for the recursive divide and conquer
- * algorithm that is stripes.
- * @return Measure and Contour of the set of rectangles.
+ * Builds the vertical edges of a set of rectangles, sorted
+ * by x-coordinate with left edges before right edges, and links
+ * each edge to the position of its partner.
+ * @param[in] rs indicates the rectangles.
+ * @param[in] n indicates the number of rectangles.
+ * @return the sorted vertical edges.
  */
-std::tuple<double, double> Guting::rectangle_DAC()
+template <class T>
+std::vector<typename Guting<T>::Edge> Guting<T>::vertical_edges(const Rectangle* rs, int n)
 {
+    PROFILE_SCOPE("edge sort");
     std::vector<Edge> vrx;
-    for(Rectangle rect : rects)
+    for(int i = 0; i < n; ++i)
     {
+        const Rectangle& rect = rs[i];
         vrx.emplace_back(
             Edge(Interval(rect.y_bot, rect.y_top), rect.x_left, rect.x_right, LEFT)
         );
         vrx.emplace_back(
             Edge(Interval(rect.y_bot, rect.y_top), rect.x_right, rect.x_left, RIGHT)
         );
+        vrx.at(2*i).partner = vrx.at(2*i + 1).partner = i;
     }
     std::sort(vrx.begin(), vrx.end());
+    std::vector<int> left(n);
+    for(int i = 0; i < 2*n; ++i)
+    {
+        Edge& e = vrx.at(i);
+        if(e.side == LEFT)
+            left.at(e.partner) = i;
+        else
+            e.partner = left.at(e.partner), vrx.at(e.partner).partner = i;
+    }
+    return vrx;
+}
+
+/**
+ * Provides an algorithm for the divide and conquer algorithm, run by
+ * stripes() or, with the bottom-up engine, by levels().
+ * @param[in] rs indicates the rectangles.
+ * @param[in] nr indicates the number of rectangles.
+ * @param[out] edges receives the edges of the contour, unless it is nullptr.
+ * @param[in] with_contour indicates whether the contour is computed. If not,
+ * no CTree is built and the contour is reported as 0.
+ * @return Measure and Contour of the set of rectangles.
+ */
+template <class T>
+std::tuple<typename Guting<T>::Area, typename Guting<T>::Area> Guting<T>::rectangle_DAC(
+    const Rectangle* rs,
+    int nr,
+    std::vector<ContourEdge>* edges,
+    bool with_contour
+)
+{
+    trees = with_contour;
+    if(threads <= 1)
+        workers.reset();
+    else if(not workers or workers->size() != threads)
+        workers.reset(new ThreadPool(threads));
+    int nt = workers ? workers->size() : 1;
+    pools.resize(nt);
+    scratch.resize(nt);
+    for(auto& arena : pools)
+        arena.reset();
+    std::vector<Edge> vrx = vertical_edges(rs, nr);
+    std::vector<Stripe> strips = std::get<3>(
+        engine == BOTTOM_UP ? levels(vrx) : stripes(vrx, 0, int(vrx.size()), Interval(-INF, INF), 0)
+    );
+    if(not with_contour)
+        return {find_measure(strips), 0};
+
     std::vector<Edge> hrx;
-    for(Rectangle rect : rects)
     {
-        hrx.emplace_back(
-            Edge(Interval(rect.x_left, rect.x_right), rect.y_bot, rect.y_top, BOT)
-        );
-        hrx.emplace_back(
-            Edge(Interval(rect.x_left, rect.x_right), rect.y_top, rect.y_bot, TOP)
-        );
+        PROFILE_SCOPE("edge sort");
+        for(int i = 0; i < nr; ++i)
+        {
+            const Rectangle& rect = rs[i];
+            hrx.emplace_back(
+                Edge(Interval(rect.x_left, rect.x_right), rect.y_bot, rect.y_top, BOT)
+            );
+            hrx.emplace_back(
+                Edge(Interval(rect.x_left, rect.x_right), rect.y_top, rect.y_bot, TOP)
+            );
+        }
+        std::sort(hrx.begin(), hrx.end(), [](const Edge& a, const Edge& b){
+            return std::tie(a.xc, a.side, a.intr.bot) < std::tie(b.xc, b.side, b.intr.bot);
+        });
     }
-    std::sort(hrx.begin(), hrx.end());
-    std::vector<Stripe> strips = std::get<3>(stripes(vrx, Interval(-INF, INF)));
-    
-    return {find_measure(strips), find_contour(strips, hrx)};
+    return {find_measure(strips), find_contour(strips, hrx, edges)};
 }
 
 /**
  * Reads a set of rectangles using x_left, x_right, y_bot and y_top.
- * Constructs the list #rects storing the rectangles.
+ * Constructs the list #rects storing the rectangles. Rectangles with no
+ * area or with a coordinate that is not a number are dropped.
  */
-void Guting::read()
+template <class T>
+void Guting<T>::read()
 {
+    PROFILE_SCOPE("read");
     std::ofstream file;
     file.open("..\\output\\rectangles.txt");
     int n;
@@ -460,9 +708,9 @@ void Guting::read()
     in >> n;
     while(n--)
     {
-        double xl, xr, yb, yt;
+        T xl, xr, yb, yt;
         in >> xl >> xr >> yb >> yt;
-        if(xl == xr or yb == yt)
+        if(not (xl < xr or xr < xl) or not (yb < yt or yt < yb)) // Also true for a NaN, read from a malformed token.
             continue;
         if(xl > xr)
             std::swap(xl, xr);
@@ -472,18 +720,199 @@ void Guting::read()
         rects.emplace_back(Rectangle(xl, xr, yb, yt));
     }
     file.close();
+    indexed = false, stale = true;
 }
 
 /**
- * Conputes the measure and contour using the divide and conquer
- * algorithm, and stores it in measure and contour variable respectively.
+ * Computes the measure and contour of a set of rectangles in memory with
+ * the selected engine. Nothing is read from or written to disk, and the
+ * instance keeps only reusable buffers between calls, so every thread
+ * may run its own instance concurrently.
+ * @param[in] rs indicates the rectangles, with x_left < x_right and y_bot < y_top.
+ * @param[in] n indicates the number of rectangles.
+ * @param[out] edges receives the edges of the contour, unless it is nullptr.
+ * Every engine but the sweep line reports edges.
+ * @param[in] with_contour indicates whether the contour is computed. If not,
+ * the divide and conquer engine builds no CTree and the contour is reported as 0.
+ * With #prefilter set the rectangles are first reduced by reduce(), which
+ * leaves the results unchanged.
+ * @return Measure and Contour of the set of rectangles.
  */
-void Guting::compute()
+template <class T>
+std::tuple<typename Guting<T>::Area, typename Guting<T>::Area> Guting<T>::run(
+    const Rectangle* rs,
+    int n,
+    std::vector<ContourEdge>* edges,
+    bool with_contour
+)
+{
+    return run(engine, rs, n, edges, with_contour);
+}
+
+/**
+ * Form of run() with the engine given explicitly. The bitmap engine falls
+ * back to the divide and conquer engine for rectangles it cannot take.
+ * Records the engine that ran in #used.
+ * @param[in] with indicates the engine to be used.
+ * @param[in] rs indicates the rectangles, with x_left < x_right and y_bot < y_top.
+ * @param[in] n indicates the number of rectangles.
+ * @param[out] edges receives the edges of the contour, unless it is nullptr.
+ * @param[in] with_contour indicates whether the contour is computed.
+ * @return Measure and Contour of the set of rectangles.
+ */
+template <class T>
+std::tuple<typename Guting<T>::Area, typename Guting<T>::Area> Guting<T>::run(
+    Engine with,
+    const Rectangle* rs,
+    int n,
+    std::vector<ContourEdge>* edges,
+    bool with_contour
+)
 {
-    std::tie(measure, contour) = rectangle_DAC();
+    std::vector<Rectangle> reduced;
+    given = n;
+    if(prefilter)
+    {
+        reduced = reduce(rs, n);
+        rs = reduced.data(), n = int(reduced.size());
+    }
+    kept = n;
+    if(with == BITMAP and not rasterizable(rs, n, false))
+        with = GUTING;
+    used = with;
+    if(n == 0)
+        return {0, 0};
+    if(with == SWEEP)
+    {
+        auto out = rectangle_sweep(rs, n);
+        if(not with_contour)
+            std::get<1>(out) = 0;
+        return out;
+    }
+    if(with == BITMAP)
+        return rectangle_bitmap(rs, n, edges, with_contour);
+    return rectangle_DAC(rs, n, edges, with_contour);
+}
+
+/**
+ * Reentrant form of run() using a single-threaded instance private to
+ * the calling thread, whose buffers are reused by later calls.
+ * @param[in] rs indicates the rectangles, with x_left < x_right and y_bot < y_top.
+ * @param[in] n indicates the number of rectangles.
+ * @param[out] edges receives the edges of the contour, unless it is nullptr.
+ * @param[in] engine indicates the algorithm to be used.
+ * @param[in] with_contour indicates whether the contour is computed.
+ * @return Measure and Contour of the set of rectangles.
+ */
+template <class T>
+std::tuple<typename Guting<T>::Area, typename Guting<T>::Area> Guting<T>::solve(
+    const Rectangle* rs,
+    int n,
+    std::vector<ContourEdge>* edges,
+    Engine engine,
+    bool with_contour
+)
+{
+    thread_local Guting workspace;
+    workspace.engine = engine;
+    return workspace.run(rs, n, edges, with_contour);
+}
+
+/**
+ * Appends the rectangles held in four coordinate columns to #rects,
+ * dropping and fixing them like read() does.
+ * @param[in] xl indicates the x_left column.
+ * @param[in] xr indicates the x_right column.
+ * @param[in] yb indicates the y_bot column.
+ * @param[in] yt indicates the y_top column.
+ * @param[in] n indicates the number of rectangles.
+ */
+template <class T>
+template <class U>
+void Guting<T>::load(const U* xl, const U* xr, const U* yb, const U* yt, size_t n)
+{
+    rects.reserve(rects.size() + n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        T l = T(xl[i]), r = T(xr[i]), b = T(yb[i]), t = T(yt[i]);
+        if(not (l < r or r < l) or not (b < t or t < b))
+            continue;
+        if(l > r)
+            std::swap(l, r);
+        if(b > t)
+            std::swap(b, t);
+        rects.emplace_back(Rectangle(l, r, b, t));
+    }
+    indexed = false, stale = true;
+}
+
+/**
+ * Reads a set of rectangles from a binary rectangle file (see RectFile).
+ * The file is mapped into memory and its columns are read in place.
+ * Unlike read(), the rectangles are not echoed to rectangles.txt.
+ * @param[in] path indicates the file to be read.
+ * @return whether the file could be read.
+ */
+template <class T>
+bool Guting<T>::read_binary(const char* path)
+{
+    PROFILE_SCOPE("read");
+    RectFile file;
+    if(not file.open(path))
+        return false;
+    size_t n = file.size();
+    switch(file.type())
+    {
+    case RectFile::INT32:
+        load(file.column<int32_t>(0), file.column<int32_t>(1), file.column<int32_t>(2), file.column<int32_t>(3), n);
+        break;
+    case RectFile::INT64:
+        load(file.column<int64_t>(0), file.column<int64_t>(1), file.column<int64_t>(2), file.column<int64_t>(3), n);
+        break;
+    default:
+        load(file.column<double>(0), file.column<double>(1), file.column<double>(2), file.column<double>(3), n);
+    }
+    return true;
+}
+
+/**
+ * Conputes the measure and contour using the selected engine, either the
+ * divide and conquer algorithm, recursive or bottom-up, the sweep line or
+ * the bitmap, and stores it in measure and contour variable respectively.
+ * With the default engine, rectangles on a small integer grid go to the
+ * bitmap engine instead when that is estimated to be cheaper (see
+ * rasterizable()). Writes the results and
+ * the contour edges to the output directory. With #measure_only set only
+ * the measure is computed and written.
+ */
+template <class T>
+void Guting<T>::compute()
+{
+    allocations = 0, arena_bytes = 0;
+    std::vector<ContourEdge> edges;
+    Engine with = engine;
+    if(engine == GUTING and rasterizable(rects.data(), int(rects.size()), true))
+        with = BITMAP;
+    std::tie(measure, contour) = run(with, rects.data(), int(rects.size()), &edges, not measure_only);
+    if(used == GUTING or used == BOTTOM_UP)
+        for(auto& arena : pools)
+            allocations += arena.allocations(), arena_bytes += arena.bytes();
+    stale = measure_only;
     std::ofstream file;
+    if(used != SWEEP and not measure_only)
+    {
+        file.open("..\\output\\contour_edges.txt");
+        for(ContourEdge& e : edges)
+            file << e.x << ' ' << e.y << ' ' << (long double)e.dx << ' ' << (long double)e.dy << '\n';
+        file.close();
+    }
     file.open("..\\output\\result.txt");
-    file << measure << '\n';
-    file << contour << '\n';
+    file << (long double)measure << '\n';
+    if(not measure_only)
+        file << (long double)contour << '\n';
     file.close();
-}
\ No newline at end of file
+}
+
+template class Guting<int32_t>;
+template class Guting<int64_t>;
+template class Guting<double>;
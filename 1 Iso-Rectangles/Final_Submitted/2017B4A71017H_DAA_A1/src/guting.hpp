@@ -1,16 +1,119 @@
 #include <vector>
+#include <tuple>
 #include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "arena.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Compile-time properties of a coordinate type T: the sentinels that stand
+ * for infinity, the type of a length (a difference of two coordinates)
+ * and the type in which areas and contours are summed.
+ * Integer coordinates get exact, wider types so that no sum overflows.
+ */
+template <class T>
+class Coord;
+
+template <>
+class Coord<int32_t>
+{
+public:
+    typedef int64_t Len;
+    typedef __int128 Area;
+    static constexpr int32_t INF = std::numeric_limits<int32_t>::max();
+
+    /**
+     * @return a coordinate between a and b, with a <= b.
+     */
+    static int32_t mid(int32_t a, int32_t b)
+    {
+        return int32_t(a + (Len(b) - a)/2);
+    }
+};
+
+template <>
+class Coord<int64_t>
+{
+public:
+    typedef __int128 Len;
+    typedef __int128 Area;
+    static constexpr int64_t INF = std::numeric_limits<int64_t>::max();
+
+    /**
+     * @return a coordinate between a and b, with a <= b.
+     */
+    static int64_t mid(int64_t a, int64_t b)
+    {
+        return int64_t(a + (Len(b) - a)/2);
+    }
+};
+
+template <>
+class Coord<double>
+{
+public:
+    typedef double Len;
+    typedef double Area;
+    static constexpr double INF = std::numeric_limits<double>::infinity();
+
+    /**
+     * @return the midpoint of a and b.
+     */
+    static double mid(double a, double b)
+    {
+        return (a + b)/2;
+    }
+};
 
 /**
  * Implements a solution to the Measure and Contour problem by using
  * a single time-optimal divide-and-conquer algorithm.
+ * @tparam T indicates the coordinate type: int32_t, int64_t or double.
  */
+template <class T = double>
 class Guting
 {
+public:
+    typedef typename Coord<T>::Len Len; ///< Type of a length along one axis.
+    typedef typename Coord<T>::Area Area; ///< Type of an area or a contour length.
+
+    /**
+     * Represents a rectangle with x_left, x_right, y_bot and y_top
+     */
+    class Rectangle
+    {
+    public:
+        T x_left, x_right, y_bot, y_top;
+
+        Rectangle(T l, T r, T b, T t)
+        {
+            x_left = l, x_right = r, y_bot = b, y_top = t;
+        }
+    };
+
+    /**
+     * Represents an edge of the contour starting at (x, y) and
+     * extending by dx horizontally or by dy vertically.
+     */
+    class ContourEdge
+    {
+    public:
+        T x, y;
+        Len dx, dy;
+
+        ContourEdge(T x, T y, Len dx, Len dy)
+        {
+            this->x = x, this->y = y, this->dx = dx, this->dy = dy;
+        }
+    };
+
+    enum Engine{GUTING, SWEEP, BOTTOM_UP, BITMAP}; ///< Algorithm used to compute measure and contour.
+
 private:
-    const double INF = std::numeric_limits<double>::infinity(); ///< Represents infinity.
-    std::vector<double> leaf; ///< Stores the x-coordinate of leaf nodes of the binary search tree.
-    std::vector<std::tuple<double, double, double, bool>> cont; ///< Stores the horizontal contour edges.
+    static constexpr T INF = Coord<T>::INF; ///< Represents infinity.
+    typedef std::tuple<T, T, T, bool> HEdge; ///< Horizontal contour piece (y, x_left, x_right, is top).
 
     /**
      * Represents interval which can be x interval or y interval.
@@ -18,10 +121,10 @@ private:
     class Interval
     {
     public:
-        double bot, top;
+        T bot, top;
         Interval(){}
 
-        Interval(double bot, double top)
+        Interval(T bot, T top)
         {
             this->bot = bot, this->top = top;
         }
@@ -43,23 +146,9 @@ private:
             return b.bot <= bot and top <= b.top;
         }
 
-        double width() const
-        {
-            return top - bot;
-        }
-    };
-
-    /**
-     * Represents a rectangle with x_left, x_right, y_bot and y_top
-     */
-    class Rectangle
-    {
-    public:
-        double x_left, x_right, y_bot, y_top;
-
-        Rectangle(double l, double r, double b, double t)
+        Len width() const
         {
-            x_left = l, x_right = r, y_bot = b, y_top = t;
+            return Len(top) - bot;
         }
     };
 
@@ -76,10 +165,11 @@ private:
     {
     public:
         Interval intr;
-        double xc, xp;
+        T xc, xp;
+        int partner = -1; ///< Position of the partner among the sorted vertical edges.
 
         enum edgetype side;
-        Edge(Interval intr, double xc, double xp, enum edgetype side)
+        Edge(Interval intr, T xc, T xp, enum edgetype side)
         {
             this->intr = intr;
             this->xc = xc;
@@ -104,7 +194,7 @@ private:
     class CTree
     {
     public:
-        double x;
+        T x;
         LRU parity;
         CTree *lson, *rson;
         CTree()
@@ -114,13 +204,13 @@ private:
             lson = NULL;
             rson = NULL;
         }
-        CTree(double x, LRU parity)
+        CTree(T x, LRU parity)
         {
             this->x = x;
             this->parity = parity;
             lson = NULL, rson = NULL;
         }
-        CTree(double x, LRU parity, CTree* lson, CTree* rson)
+        CTree(T x, LRU parity, CTree* lson, CTree* rson)
         {
             this->x = x;
             this->parity = parity;
@@ -130,46 +220,174 @@ private:
     };
 
     /**
-     * Represents a stripe which is a rectangular area
-     * defined by x_interval and y_interval.
+     * Represents a stripe which is a rectangular area defined by the
+     * x-interval of its frame and y_interval. The frame is known from
+     * the recursion, so only the y-interval is stored.
      */
     class Stripe
     {
     public:
-        Interval x_intr, y_intr;
-        double measure;
+        Interval y_intr;
+        Len measure;
         CTree* ctree;
-        std::vector<double> leaf;
 
-        Stripe(Interval xi, Interval yi, double msr, CTree* ct)
+        Stripe(Interval yi, Len msr, CTree* ct)
         {
-            x_intr = xi, y_intr = yi, measure = msr, ctree = ct;
+            y_intr = yi, measure = msr, ctree = ct;
         }
     };
 
+    std::vector<Arena<CTree>> pools; ///< Allocates the CTree nodes of the current computation, one arena per thread.
+    CTree empty; ///< Shared tree of every stripe that has no leaves.
+    bool trees = true; ///< Whether the current computation builds the CTrees needed for the contour.
+
     typedef std::tuple<
                 std::vector<Edge>,
                 std::vector<Edge>,
-                std::vector<double>,
+                std::vector<T>,
                 std::vector<Stripe>
             > LRPS;
 
-    std::vector<Interval> partitions(std::vector<double>&);
-    std::vector<Stripe> copy(std::vector<Stripe>&, std::vector<double>&, Interval);
-    void blacken(std::vector<Stripe>&, std::vector<Edge>&);
-    std::vector<Stripe> concat(std::vector<Stripe>&, std::vector<Stripe>&, std::vector<double>&, Interval);
-    LRPS merge(LRPS, LRPS, Interval, double);
-    LRPS stripes(std::vector<Edge>, Interval);
-    double find_measure(std::vector<Stripe>&);
-    void dfs(CTree *tree);
-    void construct_leaf(std::vector<Stripe>&);
-    void query(Interval, std::vector<double>&, double, bool);
-    double find_contour(std::vector<Stripe>&, std::vector<Edge>&);
-    std::tuple<double, double> rectangle_DAC();
+    /**
+     * Buffers reused by every merge step at one depth of the recursion,
+     * or at one level of levels().
+     */
+    class Scratch
+    {
+    public:
+        std::vector<T> p;
+        std::vector<Edge> e;
+        std::vector<Stripe> sl, sr;
+        LRPS frame; ///< Frame of this level waiting to be merged by levels().
+    };
+
+    /**
+     * Leaves of the stripes queried by find_contour(), in one array:
+     * the leaves of the k-th stripe gathered are values[offsets[k]]
+     * up to values[offsets[k+1]].
+     */
+    class Leaves
+    {
+    public:
+        std::vector<size_t> offsets;
+        std::vector<T> values;
+    };
+
+    Leaves leaves; ///< Leaves of the current computation, reused by the next.
+    std::vector<std::vector<Scratch>> scratch; ///< Scratch buffers of each thread and recursion depth.
+    std::unique_ptr<ThreadPool> workers; ///< Runs the two halves of large frames in parallel.
+
+    int thread() const;
+    Arena<CTree>& pool();
+
+    std::vector<Interval> partitions(std::vector<T>&);
+    void copy(std::vector<Stripe>&, std::vector<T>&, std::vector<Stripe>&);
+    void blacken(std::vector<Stripe>&, std::vector<Edge>&, int, int, Len);
+    void concat(std::vector<Stripe>&, std::vector<Stripe>&, std::vector<T>&, T, std::vector<Stripe>&);
+    LRPS merge(LRPS&, LRPS&, Interval, T, int, int, int);
+    T boundary(std::vector<Edge>&, int);
+    void base(const Edge&, Interval, LRPS&);
+    LRPS stripes(std::vector<Edge>&, int, int, Interval, int);
+    LRPS levels(std::vector<Edge>&, int, int);
+    LRPS levels(std::vector<Edge>&);
+    Area find_measure(std::vector<Stripe>&);
+    void dfs(CTree *tree, std::vector<T>&);
+    void construct_leaf(Stripe&);
+    void query(std::vector<Edge>&, int, int, const T*, const T*, bool, std::vector<HEdge>&);
+    Area find_contour(std::vector<Stripe>&, std::vector<Edge>&, std::vector<ContourEdge>*);
+    std::vector<Edge> vertical_edges(const Rectangle*, int);
+    std::tuple<Area, Area> rectangle_DAC(const Rectangle*, int, std::vector<ContourEdge>*, bool);
+
+    /**
+     * Segment tree over the elementary y-intervals between consecutive
+     * distinct y-coordinates, kept in flat arrays indexed by node.
+     * Each node stores how many rectangles cover it entirely (cnt),
+     * the covered length below it (len), the number of disjoint covered
+     * segments below it (segs) and whether its lowest and highest
+     * elementary intervals are covered (lcov, rcov).
+     */
+    class CoverTree
+    {
+        int m; ///< Number of elementary intervals.
+        std::vector<T> ys;
+        std::vector<Len> len;
+        std::vector<int> cnt, segs;
+        std::vector<char> lcov, rcov;
+        void pull(int, int, int);
+        void update(int, int, int, int, int, int);
+    public:
+        void build(std::vector<T>&);
+        void add(Interval, int);
+        Len covered() const;
+        int segments() const;
+    };
+
+    std::tuple<Area, Area> rectangle_sweep(const Rectangle*, int);
+
+    static const int _MAX_SIDE = 1 << 30; ///< Longest side, in cells, of the bitmap engine's grid, so that cell positions fit in an int.
+    static const int _ROW_WORDS = 16; ///< Cost of a row of the bitmap engine's grid besides its words, in words.
+    static const int _DAC_WORDS = 64; ///< Cost of the divide and conquer engine per n log n, in words of the bitmap engine.
+    bool rasterizable(const Rectangle*, int, bool);
+    static void runs(const uint64_t*, int, std::vector<std::tuple<int, int>>&);
+    std::tuple<Area, Area> rectangle_bitmap(const Rectangle*, int, std::vector<ContourEdge>*, bool);
+    std::tuple<Area, Area> run(Engine, const Rectangle*, int, std::vector<ContourEdge>*, bool);
+
+    /**
+     * A run of the rectangles of #rects that are consecutive by x_left,
+     * with the largest x_right among them, so that covered() can skip
+     * the whole run when it ends before the query.
+     */
+    class Block
+    {
+    public:
+        std::vector<int> ids; ///< Positions in #rects, by increasing x_left.
+        T reach; ///< Largest x_right of the rectangles in ids.
+    };
+
+    static const int _MIN_BLOCK = 16; ///< Fewest rectangles per block after a rebuild.
+    std::vector<Block> blocks; ///< Nonempty blocks covering #rects, by increasing x_left.
+    int block_size = _MIN_BLOCK; ///< Rectangles per block at the last rebuild; blocks are split past twice this.
+    int built = 0; ///< Number of rectangles at the last rebuild.
+    bool indexed = false; ///< Whether #blocks and #measure describe #rects.
+    bool stale = true; ///< Whether #contour is out of date with respect to #rects.
+
+    void build_index();
+    void rebuild();
+    void refresh(Block&);
+    std::tuple<int, int> locate(const Rectangle&, int);
+    Area covered(Rectangle, int);
+
+    void join(std::vector<Rectangle>&);
+    std::vector<Rectangle> reduce(const Rectangle*, int);
+
+    template <class U>
+    void load(const U*, const U*, const U*, const U*, size_t);
 
 public:
-    double measure; ///< Stores the measure (area) of the set of rectangles in input
-    double contour; ///< Stores the contour (perimeter length) of the set of rectangles in input.
+    Area measure; ///< Stores the measure (area) of the set of rectangles in input
+    Area contour; ///< Stores the contour (perimeter length) of the set of rectangles in input.
+    long long allocations; ///< Number of CTree nodes allocated by the last computation.
+    size_t arena_bytes; ///< Bytes of CTree nodes allocated by the last computation.
+    int threads = 1; ///< Number of threads used by compute().
+    int cutoff = 4096; ///< Frames with fewer edges than this are computed sequentially.
+    Engine engine = GUTING; ///< Algorithm used by compute().
+    Engine used = GUTING; ///< Algorithm that ran the last computation.
+    long long bitmap_cells = 1 << 22; ///< Largest grid of the bitmap engine, in cells with each row rounded up to whole words; 0 disables it.
+    bool measure_only = false; ///< Whether compute() skips the contour, leaving it 0.
+    bool prefilter = false; ///< Whether run() first drops the rectangles that do not change the union.
+    int given = 0; ///< Number of rectangles passed to the last run().
+    int kept = 0; ///< Number of rectangles of the last run() left for the engine.
     void read();
+    bool read_binary(const char*);
     void compute();
-};
\ No newline at end of file
+    std::tuple<Area, Area> run(const Rectangle*, int, std::vector<ContourEdge>* = nullptr, bool = true);
+    static std::tuple<Area, Area> solve(const Rectangle*, int, std::vector<ContourEdge>* = nullptr, Engine = GUTING, bool = true);
+    void insert(T, T, T, T);
+    bool erase(T, T, T, T);
+    Area get_contour();
+};
+
+// Instantiated in guting.cpp and, for the members defined elsewhere, in their own files.
+extern template class Guting<int32_t>;
+extern template class Guting<int64_t>;
+extern template class Guting<double>;
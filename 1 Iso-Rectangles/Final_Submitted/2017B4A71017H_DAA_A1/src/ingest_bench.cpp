@@ -0,0 +1,67 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "io.hpp"
+#include "rectfile.hpp"
+
+/**
+ * Compares the time to load the same rectangles from the text format
+ * (parsed by Input) and from the binary format (mapped by RectFile).
+ * Build with: g++ -O2 -std=c++17 ingest_bench.cpp io.cpp rectfile.cpp
+ * Usage: ingest_bench [n] (default 10^7 rectangles)
+ * Writes bench_rects.txt and bench_rects.bin in the current directory.
+ */
+int main(int argc, char const *argv[])
+{
+    long long n = argc > 1 ? atoll(argv[1]) : 10000000;
+    std::vector<double> cols[4];
+    std::mt19937 rng(41);
+    std::uniform_int_distribution<int> dist(-1000000, 1000000);
+    for(auto& col : cols)
+        col.resize(n);
+    for(long long i = 0; i < n; ++i)
+        for(auto& col : cols)
+            col[i] = dist(rng);
+
+    {
+        std::ofstream file("bench_rects.txt");
+        file << n << '\n';
+        for(long long i = 0; i < n; ++i)
+            file << cols[0][i] << ' ' << cols[1][i] << ' ' << cols[2][i] << ' ' << cols[3][i] << '\n';
+    }
+    RectFile::write("bench_rects.bin", RectFile::INT32, cols);
+
+    auto t0 = std::chrono::steady_clock::now();
+    if(not freopen("bench_rects.txt", "r", stdin))
+        return 1;
+    Input in;
+    int m;
+    in >> m;
+    std::vector<double> text(4 * size_t(m));
+    for(double& x : text)
+        in >> x;
+    auto t1 = std::chrono::steady_clock::now();
+
+    RectFile file;
+    if(not file.open("bench_rects.bin"))
+        return 1;
+    std::vector<double> binary(4 * file.size());
+    for(int k = 0; k < 4; ++k)
+    {
+        const int32_t* col = file.column<int32_t>(k);
+        for(size_t i = 0; i < file.size(); ++i)
+            binary[4*i + k] = col[i];
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double ms_text = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double ms_bin = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    std::cout << "Rectangles:                         " << n;
+    std::cout << "\nText load:                          " << int(ms_text) << " ms";
+    std::cout << "\nBinary load:                        " << int(ms_bin) << " ms";
+    std::cout << "\nLoads agree:                        " << (text == binary ? "yes" : "no") << '\n';
+    return 0;
+}
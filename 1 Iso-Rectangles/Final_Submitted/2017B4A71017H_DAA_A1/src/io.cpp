@@ -1,4 +1,6 @@
 #include <cstdio>
+#include <charconv>
+#include <limits>
 #include "io.hpp"
 
 /**
@@ -36,7 +38,7 @@ int Input::_read_char()
  * Reads the next (whitespace-separated) integer from the input buffer.
  * @return the integer read.
  */
-template <class T = int>
+template <class T>
 T Input::_read_int()
 {
     int s = 1, c = _read_char();
@@ -48,6 +50,29 @@ T Input::_read_int()
     return s ? x : -x;
 }
 
+/**
+ * Reads the next (whitespace-separated) real number from the input buffer.
+ * Accepts an optional sign, a fractional part and an exponent, and
+ * converts the token with std::from_chars so the result is correctly rounded.
+ * A token that is not entirely a number, or is longer than 127 characters,
+ * is consumed whole and read as NaN.
+ * @return the number read.
+ */
+double Input::_read_double()
+{
+    char s[128];
+    int n = 0, c = _read_char();
+    for(; c > 32; c = _get_char(), ++n)
+        if(n < 127)
+            s[n] = char(c);
+    double x = std::numeric_limits<double>::quiet_NaN();
+    if(n > 127)
+        return x;
+    const char* first = s + (n and s[0] == '+');
+    auto [end, error] = std::from_chars(first, s + n, x);
+    return error == std::errc() and end == s + n ? x : std::numeric_limits<double>::quiet_NaN();
+}
+
 /**
  * Chained istream operator for reading an integer from the input buffer.
  * @param[in] in instance of Input class.
@@ -61,14 +86,38 @@ Input& operator>>(Input& in, int& x)
 }
 
 /**
- * Chained istream operator for reading a double (but it's an integer) from the input buffer.
+ * Chained istream operator for reading a long from the input buffer.
  * @param[in] in instance of Input class.
- * @param[out] x int variable in which the integer is to be read.
+ * @param[out] x long variable in which the number is to be read.
+ * @return reference to the Input instance for chaining.
+ */
+Input& operator>>(Input& in, long& x)
+{
+    x = Input::_read_int<long>();
+    return in;
+}
+
+/**
+ * Chained istream operator for reading a long long from the input buffer.
+ * @param[in] in instance of Input class.
+ * @param[out] x long long variable in which the number is to be read.
+ * @return reference to the Input instance for chaining.
+ */
+Input& operator>>(Input& in, long long& x)
+{
+    x = Input::_read_int<long long>();
+    return in;
+}
+
+/**
+ * Chained istream operator for reading a double from the input buffer.
+ * @param[in] in instance of Input class.
+ * @param[out] x double variable in which the number is to be read.
  * @return reference to the Input instance for chaining.
  */
 Input& operator>>(Input& in, double& x)
 {
-    x = Input::_read_int();
+    x = Input::_read_double();
     return in;
 }
 
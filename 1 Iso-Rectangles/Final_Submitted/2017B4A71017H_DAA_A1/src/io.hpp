@@ -7,12 +7,15 @@
  */
 class Input
 {
-    static const int _BUF_SIZE = 4096;  ///< Input buffer size (for STDIN).
+    static const int _BUF_SIZE = 1 << 20;  ///< Input buffer size (for STDIN).
     inline static int _eof_found;   ///< Indicates if EOF has been encountered.
     inline static int _get_char();
     inline static int _read_char();
     template <class T = int> inline static T _read_int();
+    inline static double _read_double();
     friend Input& operator>>(Input&, int&);
+    friend Input& operator>>(Input&, long&);
+    friend Input& operator>>(Input&, long long&);
     friend Input& operator>>(Input&, double&);
     friend Input& operator>>(Input&, std::string&);
 public:
@@ -1,17 +1,237 @@
 #include "guting.hpp"
+#include "profile.hpp"
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
 #include <iostream>
+#include <fstream>
 #include <iomanip>
+#include <random>
 
+#ifndef COORD
+#define COORD double ///< Coordinate type, one of int32_t, int64_t or double.
+#endif
+
+typedef Guting<COORD> Solver;
+
+const char* engine_names[] = {"guting", "sweep", "bottomup", "bitmap"}; ///< Names of the engines, as given to -e.
+
+/**
+ * Runs compute() with 1 to guting.threads threads and prints the wall time
+ * and speedup of each run, checking that all runs agree with the serial one.
+ */
+void scaling(Solver& guting)
+{
+    int n = guting.threads;
+    double base = 0;
+    Solver::Area m = 0, c = 0;
+    std::cout << "\nThreads    Time (ms)    Speedup\n";
+    for(int t = 1; t <= n; ++t)
+    {
+        guting.threads = t;
+        auto t0 = std::chrono::steady_clock::now();
+        guting.compute();
+        auto t1 = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        if(t == 1)
+            base = ms, m = guting.measure, c = guting.contour;
+        std::cout << std::setw(7) << t << std::setw(13) << int(ms) << std::setw(11) << std::setprecision(3) << base / ms;
+        if(guting.measure != m or guting.contour != c)
+            std::cout << "    MISMATCH";
+        std::cout << '\n';
+    }
+}
+
+/**
+ * Runs compute() once with every engine on the same input and prints
+ * the wall time and results of each. The divide and conquer engine is
+ * not replaced by the bitmap engine here; a bitmap engine that cannot
+ * take the input is reported as the engine it fell back to.
+ */
+void engines(Solver& guting)
+{
+    long long cells = guting.bitmap_cells;
+    std::cout << "\nEngine     Time (ms)    Measure    Contour\n";
+    for(auto engine : {Solver::GUTING, Solver::SWEEP, Solver::BOTTOM_UP, Solver::BITMAP})
+    {
+        guting.engine = engine;
+        guting.bitmap_cells = engine == Solver::GUTING ? 0 : cells;
+        auto t0 = std::chrono::steady_clock::now();
+        guting.compute();
+        auto t1 = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        std::cout << std::setw(6) << engine_names[guting.used] << std::setw(14) << int(ms);
+        std::cout << std::setprecision(15) << "    " << (long double)guting.measure << "    " << (long double)guting.contour << '\n';
+    }
+    guting.bitmap_cells = cells;
+}
+
+/**
+ * Runs compute() with the divide and conquer engine in the full and in
+ * the measure-only mode and prints the wall time, CTree memory and
+ * measure of each. Then checks that get_contour() after the measure-only
+ * run recomputes the contour of the full run.
+ */
+void modes(Solver& guting)
+{
+    const char* names[] = {"full", "measure"};
+    long long cells = guting.bitmap_cells;
+    Solver::Area full = 0;
+    guting.engine = Solver::GUTING;
+    guting.bitmap_cells = 0;
+    std::cout << "\nMode       Time (ms)    CTree allocations    CTree memory (bytes)    Measure\n";
+    for(int only = 0; only < 2; ++only)
+    {
+        guting.measure_only = only;
+        auto t0 = std::chrono::steady_clock::now();
+        guting.compute();
+        auto t1 = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        std::cout << std::setw(7) << names[only] << std::setw(13) << int(ms) << std::setw(21) << guting.allocations;
+        std::cout << std::setw(24) << guting.arena_bytes << std::setprecision(15) << "    " << (long double)guting.measure << '\n';
+        if(not only)
+            full = guting.contour;
+    }
+    Solver::Area lazy = guting.get_contour();
+    std::cout << "Contour after the measure-only run: " << (long double)lazy << (lazy != full ? "    MISMATCH" : "") << '\n';
+    guting.measure_only = false;
+    guting.bitmap_cells = cells;
+}
+
+/**
+ * Inserts k random rectangles through the dynamic index and erases them
+ * again. Prints the average time per edit and checks the maintained
+ * measure against a full recomputation after each phase.
+ * @param[in] k indicates the number of rectangles to be edited.
+ */
+void edits(Solver& guting, int k)
+{
+    std::vector<std::tuple<COORD, COORD, COORD, COORD>> picked;
+    std::mt19937 rng(41);
+    std::uniform_int_distribution<int> coord(-1000, 1000), side(1, 50);
+    for(int i = 0; i < k; ++i)
+    {
+        COORD xl = coord(rng), yb = coord(rng);
+        picked.push_back({xl, COORD(xl + side(rng)), yb, COORD(yb + side(rng))});
+    }
+    std::cout << "\nPhase     Time per edit (us)    Maintained measure    Recomputed measure\n";
+    for(int phase = 0; phase < 2; ++phase)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        for(auto [xl, xr, yb, yt] : picked)
+        {
+            if(phase == 0)
+                guting.insert(xl, xr, yb, yt);
+            else
+                guting.erase(xl, xr, yb, yt);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(t1 - t0).count() / k;
+        Solver::Area kept = guting.measure;
+        guting.compute();
+        std::cout << (phase ? "erase " : "insert") << std::setw(18) << std::setprecision(4) << us;
+        std::cout << std::setprecision(15) << std::setw(22) << (long double)kept << std::setw(22) << (long double)guting.measure << '\n';
+    }
+}
+
+/**
+ * Usage: main [-t threads] [-c cutoff] [-s] [-e guting|sweep|bottomup|bitmap] [-g cells] [-p] [-m] [-b] [-u edits] [-f file] [-j report] < input
+ * -t sets the number of threads, -c the smallest frame that is split
+ * across threads and -s prints the speedup for 1 to threads threads.
+ * -e selects the engine, rejecting any other name, and -m computes the measure
+ * only, without the contour.
+ * With -e guting, inputs on an integer grid of at most cells cells (-g, 0 to
+ * disable) are computed by the bitmap engine when it is estimated to be faster.
+ * -p drops duplicate and covered rectangles and joins touching ones first.
+ * -b runs every engine and both modes on the input.
+ * -u times inserting and erasing edits rectangles through the dynamic index.
+ * -f reads the rectangles from a binary rectangle file instead of STDIN.
+ * -j writes the per-phase timings as JSON; build with -DPROFILE to record them.
+ * The coordinate type is chosen at compile time, e.g. -DCOORD=int64_t.
+ */
 int main(int argc, char const *argv[])
 {
-    Guting guting;
-    guting.read();
+    Solver guting;
+    bool scale = false, bench = false;
+    int updates = 0;
+    const char* binary = nullptr;
+    const char* report = nullptr;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(not strcmp(argv[i], "-t") and i+1 < argc)
+            guting.threads = atoi(argv[++i]);
+        else if(not strcmp(argv[i], "-c") and i+1 < argc)
+            guting.cutoff = atoi(argv[++i]);
+        else if(not strcmp(argv[i], "-s"))
+            scale = true;
+        else if(not strcmp(argv[i], "-e") and i+1 < argc)
+        {
+            int k = 0;
+            while(k < 4 and strcmp(argv[i+1], engine_names[k]))
+                ++k;
+            if(k == 4)
+            {
+                std::cerr << "Unknown engine " << argv[i+1] << "\nUsage: -e guting|sweep|bottomup|bitmap\n";
+                return 1;
+            }
+            guting.engine = Solver::Engine(k);
+            ++i;
+        }
+        else if(not strcmp(argv[i], "-g") and i+1 < argc)
+            guting.bitmap_cells = atoll(argv[++i]);
+        else if(not strcmp(argv[i], "-p"))
+            guting.prefilter = true;
+        else if(not strcmp(argv[i], "-m"))
+            guting.measure_only = true;
+        else if(not strcmp(argv[i], "-b"))
+            bench = true;
+        else if(not strcmp(argv[i], "-u") and i+1 < argc)
+            updates = atoi(argv[++i]);
+        else if(not strcmp(argv[i], "-f") and i+1 < argc)
+            binary = argv[++i];
+        else if(not strcmp(argv[i], "-j") and i+1 < argc)
+            report = argv[++i];
+    }
+    if(not binary)
+        guting.read();
+    else if(not guting.read_binary(binary))
+    {
+        std::cerr << "Cannot read " << binary << '\n';
+        return 1;
+    }
     clock_t t0 = clock();
+    auto w0 = std::chrono::steady_clock::now();
     guting.compute();
-    std::cout << std::setprecision(15) << "Measure (Area) = " << guting.measure << " Square Units\nContour (Perimeter) = " << guting.contour << " Units" << std::endl;
-    clock_t t1 = clock();
+    auto w1 = std::chrono::steady_clock::now();
+    std::cout << std::setprecision(15) << "Measure (Area) = " << (long double)guting.measure << " Square Units\n";
+    if(not guting.measure_only)
+        std::cout << "Contour (Perimeter) = " << (long double)guting.contour << " Units\n";
+    std::cout << std::flush;
     std::cout << "\nRunning time (input):               " << int(1000 * t0 / CLOCKS_PER_SEC) << " ms";
-    std::cout << "\nRunning time (algo):                " << int(1000 * (t1 - t0) / CLOCKS_PER_SEC) << " ms\n";
+    std::cout << "\nRunning time (algo):                " << int(std::chrono::duration<double, std::milli>(w1 - w0).count()) << " ms";
+    std::cout << "\nEngine:                             " << engine_names[guting.used];
+    std::cout << "\nThreads:                            " << guting.threads;
+    std::cout << "\nCTree allocations:                  " << guting.allocations;
+    std::cout << "\nCTree memory:                       " << guting.arena_bytes << " bytes\n";
+    if(guting.prefilter)
+    {
+        int n = guting.given;
+        std::cout << "Prefilter kept:                     " << guting.kept << " of " << n << " rectangles (";
+        std::cout << std::setprecision(3) << (n ? 100.0 * guting.kept / n : 100.0) << "%)\n";
+    }
+    if(scale)
+        scaling(guting);
+    if(bench)
+    {
+        engines(guting);
+        modes(guting);
+    }
+    if(updates)
+        edits(guting, updates);
+    if(report)
+    {
+        std::ofstream file(report);
+        Profile::report(file, "guting");
+    }
     return 0;
-}
\ No newline at end of file
+}
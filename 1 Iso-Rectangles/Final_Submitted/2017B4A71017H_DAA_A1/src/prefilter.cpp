@@ -0,0 +1,104 @@
+#include <tuple>
+#include <algorithm>
+#include "guting.hpp"
+#include "profile.hpp"
+
+/**
+ * Joins the rectangles of v that have the same y-interval and whose
+ * x-intervals touch or overlap, as their union is again a rectangle.
+ * @param[in,out] v indicates the rectangles, which are left sorted
+ * by y-interval and x_left.
+ */
+template <class T>
+void Guting<T>::join(std::vector<Rectangle>& v)
+{
+    std::sort(v.begin(), v.end(), [](const Rectangle& a, const Rectangle& b){
+        return std::tie(a.y_bot, a.y_top, a.x_left) < std::tie(b.y_bot, b.y_top, b.x_left);
+    });
+    if(v.empty())
+        return;
+    int k = 0, n = int(v.size());
+    for(int i = 1; i < n; ++i)
+    {
+        Rectangle& cur = v.at(k);
+        Rectangle& r = v.at(i);
+        if(r.y_bot == cur.y_bot and r.y_top == cur.y_top and r.x_left <= cur.x_right)
+            cur.x_right = std::max(cur.x_right, r.x_right);
+        else
+            v.at(++k) = r;
+    }
+    v.erase(v.begin() + k + 1, v.end());
+}
+
+/**
+ * Drops the rectangles that do not change the union: exact duplicates and
+ * rectangles inside another one. The rectangles are taken by increasing
+ * x_left, and a Fenwick tree over the ranks of y_bot keeps, for each prefix
+ * of y_bot, the rectangle taken so far that reaches highest. A rectangle is
+ * dropped when that one also reaches its y_top and x_right. This takes
+ * O(n log n) and finds every duplicate and most containments, though not
+ * one hidden behind a higher rectangle that ends sooner in x. Rectangles
+ * with equal y-intervals whose x-intervals touch are then joined, and
+ * likewise with x and y swapped. The union, and so the measure and the
+ * contour, is unchanged.
+ * @param[in] rs indicates the rectangles, with x_left < x_right and y_bot < y_top.
+ * @param[in] n indicates the number of rectangles.
+ * @return the rectangles left.
+ */
+template <class T>
+std::vector<typename Guting<T>::Rectangle> Guting<T>::reduce(const Rectangle* rs, int n)
+{
+    PROFILE_SCOPE("prefilter");
+    std::vector<Rectangle> in(rs, rs + n), out;
+    std::sort(in.begin(), in.end(), [](const Rectangle& a, const Rectangle& b){
+        return std::tie(a.x_left, b.x_right, a.y_bot, b.y_top) < std::tie(b.x_left, a.x_right, b.y_bot, a.y_top);
+    });
+    in.erase(std::unique(in.begin(), in.end(), [](const Rectangle& a, const Rectangle& b){
+        return std::tie(a.x_left, a.x_right, a.y_bot, a.y_top) == std::tie(b.x_left, b.x_right, b.y_bot, b.y_top);
+    }), in.end());
+
+    std::vector<T> ys;
+    for(Rectangle& r : in)
+        ys.push_back(r.y_bot);
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+    int m = int(ys.size());
+    std::vector<int> best(m + 1, -1); // Position in out of the highest rectangle of each Fenwick node.
+    auto higher = [&](int a, int b){
+        const Rectangle &ra = out.at(a), &rb = out.at(b);
+        return std::tie(ra.y_top, ra.x_right) > std::tie(rb.y_top, rb.x_right);
+    };
+    for(Rectangle& r : in)
+    {
+        int rank = int(std::lower_bound(ys.begin(), ys.end(), r.y_bot) - ys.begin()) + 1;
+        int top = -1;
+        for(int i = rank; i > 0; i -= i & -i)
+            if(best.at(i) >= 0 and (top < 0 or higher(best.at(i), top)))
+                top = best.at(i);
+        if(top >= 0 and out.at(top).y_top >= r.y_top and out.at(top).x_right >= r.x_right)
+            continue;
+        out.emplace_back(r);
+        int k = int(out.size()) - 1;
+        for(int i = rank; i <= m; i += i & -i)
+            if(best.at(i) < 0 or higher(k, best.at(i)))
+                best.at(i) = k;
+    }
+
+    join(out);
+    for(Rectangle& r : out)
+        std::swap(r.x_left, r.y_bot), std::swap(r.x_right, r.y_top);
+    join(out);
+    for(Rectangle& r : out)
+        std::swap(r.x_left, r.y_bot), std::swap(r.x_right, r.y_top);
+    return out;
+}
+
+// guting.cpp instantiates Guting itself, which only covers the members defined
+// there; the members defined here are instantiated one by one.
+#define INSTANTIATE(U) \
+    template void Guting<U>::join(std::vector<Rectangle>&); \
+    template std::vector<Guting<U>::Rectangle> Guting<U>::reduce(const Rectangle*, int);
+INSTANTIATE(int32_t)
+INSTANTIATE(int64_t)
+INSTANTIATE(double)
+#undef INSTANTIATE
@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <cstring>
+#include "rectfile.hpp"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @param[in] t indicates a coordinate type.
+ * @return size in bytes of one coordinate of type t.
+ */
+size_t RectFile::width(Type t)
+{
+    return t == INT32 ? 4 : 8;
+}
+
+/**
+ * Destructor. Unmaps the file.
+ */
+RectFile::~RectFile()
+{
+    close();
+}
+
+/**
+ * Maps a binary rectangle file into memory and checks its header.
+ * Where mmap is not available the file is read into memory instead.
+ * @param[in] path indicates the file to be opened.
+ * @return whether the file was opened and is well-formed.
+ */
+bool RectFile::open(const char* path)
+{
+    close();
+#ifndef _WIN32
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) == 0 and st.st_size > 0)
+    {
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED)
+        {
+            data = static_cast<const char*>(p), length = size_t(st.st_size);
+            madvise(p, length, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+#else
+    FILE* f = fopen(path, "rb");
+    if(not f)
+        return false;
+    char buf[1 << 16];
+    size_t got;
+    while((got = fread(buf, 1, sizeof(buf), f)) > 0)
+        copy.insert(copy.end(), buf, buf + got);
+    fclose(f);
+    data = copy.data(), length = copy.size();
+#endif
+    if(not data or length < sizeof(Header))
+        return close(), false;
+    Header h;
+    memcpy(&h, data, sizeof(Header));
+    // The count is compared by division, as a hostile one overflows the product.
+    if(memcmp(h.magic, "RECT", 4) or h.version != _VERSION or h.type > DOUBLE
+        or h.count > (length - sizeof(Header)) / (4 * width(Type(h.type))))
+        return close(), false;
+    return true;
+}
+
+/**
+ * Unmaps the file, if one is open.
+ */
+void RectFile::close()
+{
+#ifndef _WIN32
+    if(data)
+        munmap(const_cast<char*>(data), length);
+#endif
+    copy.clear();
+    data = nullptr, length = 0;
+}
+
+/**
+ * @return number of rectangles in the file.
+ */
+size_t RectFile::size() const
+{
+    return data ? reinterpret_cast<const Header*>(data)->count : 0;
+}
+
+/**
+ * @return type of the coordinates stored in the file.
+ */
+RectFile::Type RectFile::type() const
+{
+    return Type(reinterpret_cast<const Header*>(data)->type);
+}
+
+/**
+ * @param[in] k indicates the column: 0 for x_left, 1 for x_right,
+ * 2 for y_bot and 3 for y_top.
+ * @param[in] i indicates the rectangle.
+ * @return coordinate k of rectangle i, converted to double.
+ */
+double RectFile::get(int k, size_t i) const
+{
+    switch(type())
+    {
+    case INT32:
+        return column<int32_t>(k)[i];
+    case INT64:
+        return double(column<int64_t>(k)[i]);
+    default:
+        return column<double>(k)[i];
+    }
+}
+
+/**
+ * Writes rectangles to a binary rectangle file.
+ * @param[in] path indicates the file to be written.
+ * @param[in] t indicates the type in which the coordinates are stored.
+ * @param[in] cols indicates the four columns x_left, x_right, y_bot and
+ * y_top, all of the same length.
+ * @return whether the file was written.
+ */
+bool RectFile::write(const char* path, Type t, const std::vector<double>* cols)
+{
+    FILE* f = fopen(path, "wb");
+    if(not f)
+        return false;
+    Header h;
+    memcpy(h.magic, "RECT", 4);
+    h.version = _VERSION, h.type = t, h.pad = 0, h.count = cols[0].size();
+    fwrite(&h, sizeof(h), 1, f);
+    for(int k = 0; k < 4; ++k)
+    {
+        for(double x : cols[k])
+        {
+            if(t == INT32)
+            {
+                int32_t v = int32_t(x);
+                fwrite(&v, sizeof(v), 1, f);
+            }
+            else if(t == INT64)
+            {
+                int64_t v = int64_t(x);
+                fwrite(&v, sizeof(v), 1, f);
+            }
+            else
+                fwrite(&x, sizeof(x), 1, f);
+        }
+    }
+    return fclose(f) == 0;
+}
@@ -0,0 +1,63 @@
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Read-only view of a binary rectangle file mapped into memory.
+ * The file starts with a 24-byte header: the magic "RECT", a version,
+ * the coordinate type and the number of rectangles n. It is followed by
+ * four packed columns of n coordinates each, in the order x_left,
+ * x_right, y_bot and y_top. The columns are read in place, without
+ * parsing or copying.
+ */
+class RectFile
+{
+public:
+    enum Type{INT32, INT64, DOUBLE}; ///< Type of the stored coordinates.
+
+private:
+    /**
+     * Layout of the file header.
+     */
+    class Header
+    {
+    public:
+        char magic[4];
+        uint32_t version;
+        uint32_t type;
+        uint32_t pad;
+        uint64_t count;
+    };
+
+    static const uint32_t _VERSION = 1; ///< Version written by write().
+    const char* data = nullptr; ///< Start of the mapped file.
+    size_t length = 0; ///< Size of the mapped file in bytes.
+    std::vector<char> copy; ///< Holds the file where it cannot be mapped.
+    static size_t width(Type);
+
+public:
+    RectFile(){}
+    RectFile(const RectFile&) = delete;
+    RectFile& operator=(const RectFile&) = delete;
+    ~RectFile();
+
+    bool open(const char*);
+    void close();
+    size_t size() const;
+    Type type() const;
+    double get(int, size_t) const;
+
+    /**
+     * @param[in] k indicates the column: 0 for x_left, 1 for x_right,
+     * 2 for y_bot and 3 for y_top.
+     * @return pointer to the first coordinate of column k, which must
+     * be stored as T.
+     */
+    template <class T>
+    const T* column(int k) const
+    {
+        return reinterpret_cast<const T*>(data + sizeof(Header) + k * size() * sizeof(T));
+    }
+
+    static bool write(const char*, Type, const std::vector<double>*);
+};
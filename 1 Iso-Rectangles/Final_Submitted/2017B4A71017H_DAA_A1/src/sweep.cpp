@@ -0,0 +1,164 @@
+#include <tuple>
+#include <algorithm>
+#include "guting.hpp"
+#include "profile.hpp"
+
+/**
+ * Builds an empty tree over the elementary intervals of ys.
+ * @param[in] y indicates the sorted, distinct y-coordinates.
+ */
+template <class T>
+void Guting<T>::CoverTree::build(std::vector<T>& y)
+{
+    ys = y;
+    m = std::max(int(ys.size()) - 1, 1);
+    len.assign(4*m, 0);
+    cnt.assign(4*m, 0);
+    segs.assign(4*m, 0);
+    lcov.assign(4*m, 0);
+    rcov.assign(4*m, 0);
+}
+
+/**
+ * Recomputes the fields of a node from its count and its children.
+ * @param[in] node indicates the node to be updated.
+ * @param[in] l indicates the first elementary interval under node.
+ * @param[in] r indicates the last elementary interval under node.
+ */
+template <class T>
+void Guting<T>::CoverTree::pull(int node, int l, int r)
+{
+    if(cnt[node])
+    {
+        len[node] = Len(ys[r+1]) - ys[l];
+        segs[node] = 1;
+        lcov[node] = rcov[node] = 1;
+    }
+    else if(l == r)
+    {
+        len[node] = 0;
+        segs[node] = 0;
+        lcov[node] = rcov[node] = 0;
+    }
+    else
+    {
+        int a = 2*node, b = 2*node + 1;
+        len[node] = len[a] + len[b];
+        segs[node] = segs[a] + segs[b] - (rcov[a] and lcov[b]);
+        lcov[node] = lcov[a];
+        rcov[node] = rcov[b];
+    }
+}
+
+/**
+ * Adds v to the count of the elementary intervals ql to qr.
+ * @param[in] node indicates the current node, covering intervals l to r.
+ * @param[in] l indicates the first elementary interval under node.
+ * @param[in] r indicates the last elementary interval under node.
+ * @param[in] ql indicates the first elementary interval to be updated.
+ * @param[in] qr indicates the last elementary interval to be updated.
+ * @param[in] v indicates +1 for a left edge and -1 for a right edge.
+ */
+template <class T>
+void Guting<T>::CoverTree::update(int node, int l, int r, int ql, int qr, int v)
+{
+    if(qr < l or r < ql)
+        return;
+    if(ql <= l and r <= qr)
+        cnt[node] += v;
+    else
+    {
+        int mid = (l + r)/2;
+        update(2*node, l, mid, ql, qr, v);
+        update(2*node + 1, mid+1, r, ql, qr, v);
+    }
+    pull(node, l, r);
+}
+
+/**
+ * Adds v to the cover count of the y-interval intr.
+ * @param[in] intr indicates the y-interval of a vertical edge.
+ * @param[in] v indicates +1 for a left edge and -1 for a right edge.
+ */
+template <class T>
+void Guting<T>::CoverTree::add(Interval intr, int v)
+{
+    int ql = int(std::lower_bound(ys.begin(), ys.end(), intr.bot) - ys.begin());
+    int qr = int(std::lower_bound(ys.begin(), ys.end(), intr.top) - ys.begin()) - 1;
+    update(1, 0, m-1, ql, qr, v);
+}
+
+/**
+ * @return total length of the y-axis covered at the moment.
+ */
+template <class T>
+typename Guting<T>::Len Guting<T>::CoverTree::covered() const
+{
+    return len[1];
+}
+
+/**
+ * @return number of disjoint covered segments at the moment.
+ */
+template <class T>
+int Guting<T>::CoverTree::segments() const
+{
+    return segs[1];
+}
+
+/**
+ * Sweeps a vertical line over the sorted vertical edges while the
+ * CoverTree keeps the covered part of the line. Between two events the
+ * covered length gives the measure and the number of covered segments
+ * gives the horizontal contour; at each event the change in covered
+ * length gives the vertical contour.
+ * @param[in] rs indicates the rectangles.
+ * @param[in] nr indicates the number of rectangles.
+ * @return Measure and Contour of the set of rectangles.
+ */
+template <class T>
+std::tuple<typename Guting<T>::Area, typename Guting<T>::Area> Guting<T>::rectangle_sweep(const Rectangle* rs, int nr)
+{
+    PROFILE_SCOPE("sweep");
+    std::vector<Edge> vrx = vertical_edges(rs, nr);
+    std::vector<T> ys;
+    for(int i = 0; i < nr; ++i)
+        ys.push_back(rs[i].y_bot), ys.push_back(rs[i].y_top);
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    CoverTree tree;
+    tree.build(ys);
+    Area msr = 0, ctr = 0;
+    int n = int(vrx.size());
+    for(int i = 0; i < n; ++i)
+    {
+        Edge& e = vrx.at(i);
+        if(i)
+        {
+            Len dx = Len(e.xc) - vrx.at(i-1).xc;
+            msr += Area(tree.covered()) * dx;
+            ctr += Area(2 * tree.segments()) * dx;
+        }
+        Len before = tree.covered();
+        tree.add(e.intr, e.side == LEFT ? 1 : -1);
+        Len change = tree.covered() - before;
+        ctr += change < 0 ? -change : change;
+    }
+    return {msr, ctr};
+}
+
+// guting.cpp instantiates Guting itself, which only covers the members defined
+// there; the members defined here are instantiated one by one.
+#define INSTANTIATE(U) \
+    template void Guting<U>::CoverTree::build(std::vector<U>&); \
+    template void Guting<U>::CoverTree::pull(int, int, int); \
+    template void Guting<U>::CoverTree::update(int, int, int, int, int, int); \
+    template void Guting<U>::CoverTree::add(Interval, int); \
+    template Guting<U>::Len Guting<U>::CoverTree::covered() const; \
+    template int Guting<U>::CoverTree::segments() const; \
+    template std::tuple<Guting<U>::Area, Guting<U>::Area> Guting<U>::rectangle_sweep(const Rectangle*, int);
+INSTANTIATE(int32_t)
+INSTANTIATE(int64_t)
+INSTANTIATE(double)
+#undef INSTANTIATE
@@ -0,0 +1,213 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fork-join thread pool with one task deque per thread. A thread pushes
+ * and pops its own tasks at the back of its deque, and idle threads
+ * steal from the front of the other deques.
+ * Any thread that is not a worker of the pool, usually the one that
+ * created it, takes part in the work as thread 0 while it waits for the
+ * tasks it has spawned.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * A unit of work that can be spawned and waited for.
+     */
+    class Task
+    {
+    public:
+        std::function<void()> fn; ///< Work to be done.
+        std::atomic<bool> done; ///< Set once fn has returned.
+
+        explicit Task(std::function<void()> fn)
+        {
+            this->fn = std::move(fn);
+            done = false;
+        }
+    };
+
+private:
+    /**
+     * Task deque of one thread.
+     */
+    class Queue
+    {
+    public:
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; ///< Deque of every thread, including the caller.
+    std::vector<std::thread> threads; ///< Worker threads 1 to size()-1.
+    std::atomic<int> queued; ///< Number of tasks waiting in all deques.
+    std::atomic<bool> stop; ///< Tells the workers to exit.
+    std::mutex sleep_lock; ///< Guards the idle workers' sleep.
+    std::condition_variable wake; ///< Wakes idle workers when work arrives.
+
+    /**
+     * Pool that a worker thread belongs to and its index there.
+     */
+    class Member
+    {
+    public:
+        const ThreadPool* pool = nullptr;
+        int index = 0;
+    };
+
+    /**
+     * @return reference to the membership of the calling thread, which
+     * is set only in the workers of a pool.
+     */
+    static Member& self()
+    {
+        thread_local Member out;
+        return out;
+    }
+
+    /**
+     * Takes a task from the back of the own deque, or steals one
+     * from the front of another thread's deque.
+     * @param[in] self indicates the index of the calling thread.
+     * @return the task, or nullptr if every deque is empty.
+     */
+    Task* take(int self)
+    {
+        int n = int(queues.size());
+        for(int k = 0; k < n; ++k)
+        {
+            Queue& q = *queues.at((self + k) % n);
+            std::lock_guard<std::mutex> guard(q.lock);
+            if(q.tasks.empty())
+                continue;
+            Task* out;
+            if(k == 0)
+                out = q.tasks.back(), q.tasks.pop_back();
+            else
+                out = q.tasks.front(), q.tasks.pop_front();
+            --queued;
+            return out;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Runs a task and marks it as finished.
+     * @param[in] task to be run.
+     */
+    static void run(Task* task)
+    {
+        task->fn();
+        task->done.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Main loop of worker thread self.
+     */
+    void work(int self)
+    {
+        Member& me = ThreadPool::self();
+        me.pool = this, me.index = self;
+        while(not stop)
+        {
+            if(Task* task = take(self))
+            {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake.wait(guard, [&]{ return stop or queued > 0; });
+        }
+    }
+
+public:
+    /**
+     * Constructor. Starts n-1 worker threads; the calling thread is the n-th.
+     * @param[in] n indicates the total number of threads.
+     */
+    explicit ThreadPool(int n)
+    {
+        queued = 0;
+        stop = false;
+        for(int i = 0; i < n; ++i)
+            queues.emplace_back(new Queue());
+        for(int i = 1; i < n; ++i)
+            threads.emplace_back(&ThreadPool::work, this, i);
+    }
+
+    /**
+     * Destructor. Stops and joins the worker threads.
+     */
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for(std::thread& t : threads)
+            t.join();
+    }
+
+    /**
+     * @return the total number of threads, including the caller.
+     */
+    int size() const
+    {
+        return int(queues.size());
+    }
+
+    /**
+     * @return index of the calling thread in this pool, in [0, size()):
+     * that of a worker of this pool, and 0 for any other thread, even a
+     * worker of another pool.
+     */
+    int index() const
+    {
+        const Member& me = self();
+        return me.pool == this ? me.index : 0;
+    }
+
+    /**
+     * Makes a task available to the pool. The task must stay alive
+     * until wait() returns for it.
+     * @param[in] task to be spawned.
+     */
+    void spawn(Task& task)
+    {
+        Queue& q = *queues.at(index());
+        {
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.tasks.push_back(&task);
+        }
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            ++queued;
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * Blocks until the task has finished, running other
+     * pending tasks in the meantime.
+     * @param[in] task spawned earlier by the calling thread.
+     */
+    void wait(Task& task)
+    {
+        int self = index();
+        while(not task.done.load(std::memory_order_acquire))
+        {
+            if(Task* other = take(self))
+                run(other);
+            else
+                std::this_thread::yield();
+        }
+    }
+};
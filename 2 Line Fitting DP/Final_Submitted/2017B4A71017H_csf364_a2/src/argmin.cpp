@@ -0,0 +1,130 @@
+#include "argmin.hpp"
+#include <limits>
+#if defined(__AVX512F__) or defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+static constexpr double inf = std::numeric_limits<double>::infinity();
+
+/**
+ * Loop of the original DP, one sum at a time.
+ */
+int argmin_scalar(const double* a, const double* b, double c, int n, double& val)
+{
+    int ind = -1;
+    val = inf;
+    for(int i = 0; i < n; ++i)
+    {
+        if(a[i] + c + b[i] < val)
+            val = a[i] + c + b[i], ind = i;
+    }
+    return ind;
+}
+
+#if defined(__AVX512F__) or defined(__AVX2__)
+
+/**
+ * Merges the minima found by the vector lanes with those of the scalar
+ * tail. Lanes see the sums out of order, so among equal minima the
+ * smallest index wins.
+ * @param[in] vals indicates the minimum of each lane.
+ * @param[in] inds indicates the index of the minimum of each lane.
+ * @param[in] lanes indicates the number of lanes.
+ * @param[in] from indicates the first index left to the scalar tail.
+ * The other parameters are those of argmin().
+ * @return index of the first minimum, with its value in val.
+ */
+static int finish(const double* vals, const double* inds, int lanes, const double* a, const double* b, double c, int from, int n, double& val)
+{
+    int ind = -1;
+    val = inf;
+    for(int k = 0; k < lanes; ++k)
+    {
+        if(vals[k] < val or (vals[k] == val and val < inf and inds[k] < ind))
+            val = vals[k], ind = int(inds[k]);
+    }
+    for(int i = from; i < n; ++i)
+    {
+        if(a[i] + c + b[i] < val)
+            val = a[i] + c + b[i], ind = i;
+    }
+    return ind;
+}
+
+#endif
+
+#if defined(__AVX512F__)
+
+int argmin(const double* a, const double* b, double c, int n, double& val)
+{
+    // Two accumulators of 8 lanes hide the latency of the compare and blend.
+    __m512d cc = _mm512_set1_pd(c), step = _mm512_set1_pd(16);
+    __m512d best0 = _mm512_set1_pd(inf), best1 = best0;
+    __m512d at0 = _mm512_setzero_pd(), at1 = at0;
+    __m512d i0 = _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7), i1 = _mm512_add_pd(i0, _mm512_set1_pd(8));
+    int i = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        __m512d v0 = _mm512_add_pd(_mm512_add_pd(_mm512_loadu_pd(a + i), cc), _mm512_loadu_pd(b + i));
+        __m512d v1 = _mm512_add_pd(_mm512_add_pd(_mm512_loadu_pd(a + i + 8), cc), _mm512_loadu_pd(b + i + 8));
+        __mmask8 m0 = _mm512_cmp_pd_mask(v0, best0, _CMP_LT_OQ);
+        __mmask8 m1 = _mm512_cmp_pd_mask(v1, best1, _CMP_LT_OQ);
+        best0 = _mm512_mask_blend_pd(m0, best0, v0), at0 = _mm512_mask_blend_pd(m0, at0, i0);
+        best1 = _mm512_mask_blend_pd(m1, best1, v1), at1 = _mm512_mask_blend_pd(m1, at1, i1);
+        i0 = _mm512_add_pd(i0, step), i1 = _mm512_add_pd(i1, step);
+    }
+    alignas(64) double vals[16], inds[16];
+    _mm512_store_pd(vals, best0), _mm512_store_pd(vals + 8, best1);
+    _mm512_store_pd(inds, at0), _mm512_store_pd(inds + 8, at1);
+    return finish(vals, inds, 16, a, b, c, i, n, val);
+}
+
+const char* argmin_isa()
+{
+    return "avx512";
+}
+
+#elif defined(__AVX2__)
+
+int argmin(const double* a, const double* b, double c, int n, double& val)
+{
+    // Two accumulators of 4 lanes hide the latency of the compare and blend.
+    __m256d cc = _mm256_set1_pd(c), step = _mm256_set1_pd(8);
+    __m256d best0 = _mm256_set1_pd(inf), best1 = best0;
+    __m256d at0 = _mm256_setzero_pd(), at1 = at0;
+    __m256d i0 = _mm256_setr_pd(0, 1, 2, 3), i1 = _mm256_setr_pd(4, 5, 6, 7);
+    int i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256d v0 = _mm256_add_pd(_mm256_add_pd(_mm256_loadu_pd(a + i), cc), _mm256_loadu_pd(b + i));
+        __m256d v1 = _mm256_add_pd(_mm256_add_pd(_mm256_loadu_pd(a + i + 4), cc), _mm256_loadu_pd(b + i + 4));
+        __m256d m0 = _mm256_cmp_pd(v0, best0, _CMP_LT_OQ);
+        __m256d m1 = _mm256_cmp_pd(v1, best1, _CMP_LT_OQ);
+        best0 = _mm256_blendv_pd(best0, v0, m0), at0 = _mm256_blendv_pd(at0, i0, m0);
+        best1 = _mm256_blendv_pd(best1, v1, m1), at1 = _mm256_blendv_pd(at1, i1, m1);
+        i0 = _mm256_add_pd(i0, step), i1 = _mm256_add_pd(i1, step);
+    }
+    alignas(32) double vals[8], inds[8];
+    _mm256_store_pd(vals, best0), _mm256_store_pd(vals + 4, best1);
+    _mm256_store_pd(inds, at0), _mm256_store_pd(inds + 4, at1);
+    return finish(vals, inds, 8, a, b, c, i, n, val);
+}
+
+const char* argmin_isa()
+{
+    return "avx2";
+}
+
+#else
+
+int argmin(const double* a, const double* b, double c, int n, double& val)
+{
+    return argmin_scalar(a, b, c, n, val);
+}
+
+const char* argmin_isa()
+{
+    return "scalar";
+}
+
+#endif
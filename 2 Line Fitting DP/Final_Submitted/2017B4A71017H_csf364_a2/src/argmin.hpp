@@ -0,0 +1,20 @@
+/**
+ * Finds the first minimum of a[i] + c + b[i] over i = 0 to n-1, the inner
+ * step of the SLS DP. The sums are formed in that order in every version,
+ * so the values and the index found are the same. argmin() uses AVX-512
+ * or AVX2 when the compiler targets them (e.g. g++ -march=native ...) and
+ * falls back to argmin_scalar() otherwise.
+ * @param[in] a indicates the first array.
+ * @param[in] b indicates the second array.
+ * @param[in] c indicates the constant added to every sum.
+ * @param[in] n indicates the length of both arrays.
+ * @param[out] val receives the minimum, or infinity if no sum is finite.
+ * @return index of the first minimum, or -1 if there is none.
+ */
+int argmin(const double* a, const double* b, double c, int n, double& val);
+int argmin_scalar(const double* a, const double* b, double c, int n, double& val);
+
+/**
+ * @return name of the instruction set used by argmin().
+ */
+const char* argmin_isa();
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "argmin.hpp"
+
+/**
+ * Compares the time of argmin_scalar() and argmin() on the columns the
+ * SLS DP scans, i.e. every prefix of n errors and penalties, and checks
+ * that both find the same minimum at the same index. Errors are rounded
+ * to a few values so that ties occur.
+ * Build with: g++ -O2 -march=native -std=c++17 argmin_bench.cpp argmin.cpp
+ * Usage: argmin_bench [n] (default 20000)
+ */
+int main(int argc, char const *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 20000;
+    std::vector<double> a(n), b(n);
+    std::mt19937 rng(41);
+    std::uniform_int_distribution<int> dist(0, 64);
+    for(int i = 0; i < n; ++i)
+        a[i] = dist(rng) / 4.0, b[i] = dist(rng) / 4.0;
+
+    long long scalar_sum = 0, vector_sum = 0;
+    bool agree = true;
+    auto t0 = std::chrono::steady_clock::now();
+    for(int j = 1; j <= n; ++j)
+    {
+        double val;
+        scalar_sum += argmin_scalar(a.data(), b.data(), 0.5, j, val);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for(int j = 1; j <= n; ++j)
+    {
+        double val;
+        vector_sum += argmin(a.data(), b.data(), 0.5, j, val);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for(int j = 1; j <= n; j += 97)
+    {
+        double v1, v2;
+        agree = agree and argmin_scalar(a.data(), b.data(), 0.5, j, v1) == argmin(a.data(), b.data(), 0.5, j, v2) and v1 == v2;
+    }
+
+    double ms_scalar = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double ms_vector = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    std::cout << "Columns:                            " << n;
+    std::cout << "\nInstruction set:                    " << argmin_isa();
+    std::cout << "\nScalar kernel:                      " << int(ms_scalar) << " ms";
+    std::cout << "\nVector kernel:                      " << int(ms_vector) << " ms";
+    std::cout << "\nSpeedup:                            " << ms_scalar / ms_vector;
+    std::cout << "\nResults agree:                      " << (agree and scalar_sum == vector_sum ? "yes" : "no") << '\n';
+    return 0;
+}
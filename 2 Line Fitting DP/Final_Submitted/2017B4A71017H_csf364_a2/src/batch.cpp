@@ -0,0 +1,179 @@
+#include "sls.hpp"
+#include "profile.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+/**
+ * Reads series from a text or binary batch file, telling them apart by
+ * the magic of the binary header.
+ * @param[in] path indicates the file to be read.
+ * @return whether the file was read and is well-formed.
+ */
+bool Batch::load(const char* path)
+{
+    PROFILE_SCOPE("batch load");
+    series.clear();
+    FILE* f = fopen(path, "rb");
+    if (not f)
+        return false;
+    Header h;
+    bool binary = fread(&h, sizeof(h), 1, f) == 1 and not memcmp(h.magic, "SLSB", 4);
+    if (binary)
+    {
+        bool ok = h.version == _VERSION;
+        series.resize(ok ? h.count : 0);
+        for(Series& s : series)
+        {
+            int64_t id, n;
+            ok = ok and fread(&id, sizeof(id), 1, f) == 1 and fread(&n, sizeof(n), 1, f) == 1
+                and fread(&s.C, sizeof(s.C), 1, f) == 1 and n >= 0;
+            if (not ok)
+                break;
+            s.id = id;
+            s.points.resize(n);
+            for(Point& p : s.points)
+                ok = ok and fread(&p.x, sizeof(double), 1, f) == 1 and fread(&p.y, sizeof(double), 1, f) == 1;
+        }
+        fclose(f);
+        if (not ok)
+            series.clear();
+        return ok;
+    }
+    fclose(f);
+
+    std::ifstream file(path);
+    long long count, n;
+    if (not (file >> count) or count < 0)
+        return false;
+    series.resize(count);
+    for(Series& s : series)
+    {
+        if (not (file >> s.id >> n >> s.C) or n < 0)
+            return series.clear(), false;
+        s.points.resize(n);
+        for(Point& p : s.points)
+            file >> p.x >> p.y;
+    }
+    if (not file)
+        return series.clear(), false;
+    return true;
+}
+
+/**
+ * Writes the series to a binary batch file.
+ * @param[in] path indicates the file to be written.
+ * @return whether the file was written.
+ */
+bool Batch::save(const char* path) const
+{
+    FILE* f = fopen(path, "wb");
+    if (not f)
+        return false;
+    Header h;
+    memcpy(h.magic, "SLSB", 4);
+    h.version = _VERSION, h.count = series.size(), h.rows = 0;
+    fwrite(&h, sizeof(h), 1, f);
+    for(const Series& s : series)
+    {
+        int64_t id = s.id, n = int64_t(s.points.size());
+        fwrite(&id, sizeof(id), 1, f);
+        fwrite(&n, sizeof(n), 1, f);
+        fwrite(&s.C, sizeof(s.C), 1, f);
+        for(const Point& p : s.points)
+        {
+            fwrite(&p.x, sizeof(double), 1, f);
+            fwrite(&p.y, sizeof(double), 1, f);
+        }
+    }
+    return fclose(f) == 0;
+}
+
+/**
+ * Solves every series into results. The series are split into a few
+ * blocks per thread, and idle threads steal blocks from busy ones. A
+ * series without points has penalty 0 and no segments, like one with a
+ * single point.
+ */
+void Batch::run()
+{
+    PROFILE_SCOPE("batch run");
+    int nt = std::max(threads, 1);
+    std::unique_ptr<ThreadPool> pool(nt > 1 ? new ThreadPool(nt) : nullptr);
+    std::vector<SLS> solvers(nt);
+    for(SLS& sls : solvers)
+        sls.lean = lean, sls.prune = prune;
+    results.resize(series.size());
+
+    auto solve = [&](size_t from, size_t to)
+    {
+        SLS& sls = solvers[pool ? pool->index() : 0];
+        for(size_t i = from; i < to; ++i)
+        {
+            Result& r = results[i];
+            r.id = series[i].id, r.penalty = 0;
+            r.segments.clear();
+            if (series[i].points.empty())
+                continue;
+            sls.assign(series[i].points, series[i].C);
+            sls.run();
+            r.penalty = sls.min_penalty;
+            sls.get_segments(r.segments);
+        }
+    };
+    size_t m = series.size(), count = pool ? std::min(m, size_t(8 * nt)) : 1;
+    std::vector<std::unique_ptr<ThreadPool::Task>> tasks;
+    for(size_t b = 1; b < count; ++b)
+    {
+        tasks.emplace_back(new ThreadPool::Task([&, b]{ solve(m * b / count, m * (b+1) / count); }));
+        pool->spawn(*tasks.back());
+    }
+    solve(0, count ? m / count : 0);
+    for(auto& task : tasks)
+        pool->wait(*task);
+}
+
+/**
+ * Writes results to a columnar result file.
+ * @param[in] path indicates the file to be written.
+ * @return whether the file was written.
+ */
+bool Batch::write(const char* path) const
+{
+    PROFILE_SCOPE("batch write");
+    FILE* f = fopen(path, "wb");
+    if (not f)
+        return false;
+    Header h;
+    memcpy(h.magic, "SLSR", 4);
+    h.version = _VERSION, h.count = results.size(), h.rows = 0;
+    for(const Result& r : results)
+        h.rows += r.segments.size();
+    fwrite(&h, sizeof(h), 1, f);
+    for(const Result& r : results)
+    {
+        int64_t id = r.id;
+        fwrite(&id, sizeof(id), 1, f);
+    }
+    for(const Result& r : results)
+        fwrite(&r.penalty, sizeof(double), 1, f);
+    uint64_t offset = 0;
+    fwrite(&offset, sizeof(offset), 1, f);
+    for(const Result& r : results)
+    {
+        offset += r.segments.size();
+        fwrite(&offset, sizeof(offset), 1, f);
+    }
+    for(int k = 0; k < 4; ++k)
+    {
+        for(const Result& r : results)
+        {
+            for(const Segment& s : r.segments)
+            {
+                double v = k == 0 ? s.line.m : k == 1 ? s.line.c : k == 2 ? s.start : s.stop;
+                fwrite(&v, sizeof(v), 1, f);
+            }
+        }
+    }
+    return fclose(f) == 0;
+}
@@ -1,18 +1,317 @@
 #include "sls.hpp"
+#include "profile.hpp"
 #include <chrono>
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
 
+/**
+ * Runs compute() with 1 to sls.threads threads and prints the wall time
+ * and speedup of each run, checking that all runs agree with the serial one.
+ */
+void scaling(SLS& sls)
+{
+    int n = sls.threads;
+    double base = 0, penalty = 0;
+    int segments = 0;
+    std::cout << "\nThreads    Time (ms)    Speedup\n";
+    for(int t = 1; t <= n; ++t)
+    {
+        sls.threads = t;
+        auto t0 = std::chrono::steady_clock::now();
+        sls.compute();
+        auto t1 = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        if(t == 1)
+            base = ms, penalty = sls.min_penalty, segments = sls.segments;
+        std::cout << std::setw(7) << t << std::setw(13) << int(ms) << std::setw(11) << std::setprecision(3) << base / ms;
+        if(sls.min_penalty != penalty or sls.segments != segments)
+            std::cout << "    MISMATCH";
+        std::cout << '\n';
+    }
+}
+
+/**
+ * Feeds the points of sls one by one to a new solver through append() and
+ * prints the latency of the appends, checking that the final penalty
+ * matches that of compute().
+ */
+void feed(SLS& sls)
+{
+    SLS live;
+    live.C = sls.C, live.lean = sls.lean, live.threads = sls.threads;
+    std::vector<double> us;
+    for(const Point& p : sls.get_points())
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        live.append(p.x, p.y);
+        auto t1 = std::chrono::steady_clock::now();
+        us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+    }
+    double total = 0;
+    for(double t : us)
+        total += t;
+    std::sort(us.begin(), us.end());
+    size_t k = us.size();
+    double diff = std::abs(live.min_penalty - sls.min_penalty);
+    std::cout << "\nAppends:                            " << k;
+    std::cout << "\nAppend latency mean:                " << total / k << " us";
+    std::cout << "\nAppend latency p50:                 " << us[k / 2] << " us";
+    std::cout << "\nAppend latency p99:                 " << us[k * 99 / 100] << " us";
+    std::cout << "\nAppend latency max:                 " << us.back() << " us";
+    std::cout << "\nPenalty after appends:              " << live.min_penalty;
+    std::cout << "\nSegments after appends:             " << live.segments;
+    std::cout << "\nMatches compute():                  " << (diff <= 1e-6 * (std::abs(sls.min_penalty) + 1) ? "yes" : "no") << '\n';
+}
+
+/**
+ * Segments the points read from the input as a stream, writing each
+ * segment to the output as soon as it is final, and prints the penalty,
+ * the memory held and the time per point to the error output. The input
+ * is as for read(), except that the points are read until its end and
+ * must come in increasing x order.
+ * @param[in] cap indicates the most candidates and nodes to keep, or 0.
+ */
+void stream(size_t cap)
+{
+    std::ios::sync_with_stdio(false);
+    long long n;
+    double C, x, y;
+    std::cin >> n >> C;
+    Stream live(std::cout, C);
+    live.cap = cap;
+    long long buckets[64] = {}, ns_max = 0;
+    double ns_total = 0;
+    while(std::cin >> x >> y)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        live.push(x, y);
+        auto t1 = std::chrono::steady_clock::now();
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        ns_total += ns, ns_max = std::max(ns_max, ns);
+        int b = 0;
+        while(b < 63 and (2LL << b) <= ns)
+            ++b;
+        buckets[b]++;
+    }
+    double penalty = live.finish();
+    std::cout.flush();
+    long long total = 0, seen = 0;
+    for(long long c : buckets)
+        total += c;
+    int p99 = 0;
+    while(p99 < 63 and (seen += buckets[p99]) * 100 < total * 99)
+        ++p99;
+    std::cerr << "Minimum Penalty = " << penalty << std::endl;
+    std::cerr << "Number of segments = " << live.segments << std::endl;
+    std::cerr << "Multiplier C = " << C << std::endl;
+    std::cerr << "\nPoints:                             " << live.points;
+    std::cerr << "\nRejected (out of order):            " << live.rejected;
+    std::cerr << "\nPeak candidates and nodes:          " << live.peak;
+    std::cerr << "\nCuts:                               " << live.cuts;
+    std::cerr << "\nRestarts:                           " << live.restarts;
+    std::cerr << "\nError bound:                        " << live.bound();
+    std::cerr << "\nPoint latency mean:                 " << (total ? ns_total / total : 0) << " ns";
+    std::cerr << "\nPoint latency p99 (below):          " << (2LL << p99) << " ns";
+    std::cerr << "\nPoint latency max:                  " << ns_max << " ns";
+    std::cerr << "\nPeak memory (RSS):                  " << Profile::peak_rss() << " KB\n";
+}
+
+/**
+ * Solves every series of a batch file and writes the results to a
+ * columnar result file, printing the throughput.
+ * @param[in] sls indicates the options: threads, lean and prune.
+ * @param[in] in indicates the batch file, text or binary.
+ * @param[in] out indicates the result file.
+ * @param[in] copy indicates where to save the series as a binary batch file, or nullptr.
+ */
+void batch(SLS& sls, const char* in, const char* out, const char* copy)
+{
+    Batch jobs;
+    jobs.threads = sls.threads, jobs.lean = sls.lean, jobs.prune = sls.prune;
+    auto t0 = std::chrono::steady_clock::now();
+    if(not jobs.load(in))
+    {
+        std::cerr << "Cannot read batch file " << in << '\n';
+        return;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    jobs.run();
+    auto t2 = std::chrono::steady_clock::now();
+    if(not jobs.write(out))
+        std::cerr << "Cannot write result file " << out << '\n';
+    if(copy and not jobs.save(copy))
+        std::cerr << "Cannot write batch file " << copy << '\n';
+    long long points = 0, segments = 0;
+    for(auto& s : jobs.series)
+        points += s.points.size();
+    for(auto& r : jobs.results)
+        segments += r.segments.size();
+    double ms_load = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double ms_run = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    std::cout << "Series:                             " << jobs.series.size();
+    std::cout << "\nPoints:                             " << points;
+    std::cout << "\nSegments:                           " << segments;
+    std::cout << "\nThreads:                            " << jobs.threads;
+    std::cout << "\nRunning time (load):                " << int(ms_load) << " ms";
+    std::cout << "\nRunning time (solve):               " << int(ms_run) << " ms";
+    std::cout << "\nThroughput:                         " << jobs.series.size() / (ms_run / 1000) << " series/s\n";
+}
+
+/**
+ * Prints the optimal segmentation of every range of C from lo to hi.
+ */
+void path(SLS& sls, double lo, double hi)
+{
+    std::vector<Piece> pieces = sls.path(lo, hi);
+    std::cout << "C from        C to          Segments    Error         Breakpoints\n";
+    for(Piece& p : pieces)
+    {
+        std::cout << std::left << std::setw(14) << p.lo << std::setw(14) << p.hi;
+        std::cout << std::setw(12) << p.segments << std::setw(14) << p.error;
+        for(double x : p.breaks)
+            std::cout << x << ' ';
+        std::cout << '\n';
+    }
+}
+
+/**
+ * Prints the best fit with k lines for every k from 1 to K.
+ */
+void fit(SLS& sls, int K, bool at_most)
+{
+    std::vector<Piece> pieces = sls.fit(K, at_most);
+    std::cout << "k     Segments    Error         Breakpoints\n";
+    for(size_t k = 0; k < pieces.size(); ++k)
+    {
+        Piece& p = pieces[k];
+        std::cout << std::left << std::setw(6) << k+1 << std::setw(12) << p.segments << std::setw(14) << p.error;
+        for(double x : p.breaks)
+            std::cout << x << ' ';
+        std::cout << '\n';
+    }
+}
+
+/**
+ * Writes the per-phase timings as JSON, unless report is nullptr.
+ */
+void save_report(const char* report)
+{
+    if(not report)
+        return;
+    std::ofstream file(report);
+    Profile::report(file, "sls");
+}
+
+/**
+ * Usage: main [-t threads] [-s] [-l] [-p] [-i] [-r lo hi] [-k K [-a]] [-w cap] [-j report] < input
+ *        main [-t threads] [-l] [-p] -b batch [-o results] [-x copy]
+ * -t sets the number of threads and -s prints the speedup for 1 to threads
+ * threads.
+ * -l computes segment errors on demand, using O(n) instead of O(n^2) memory.
+ * -p prunes breakpoints that can no longer be optimal from the DP, and
+ * implies -l.
+ * -i also appends the points one at a time and prints the append latency.
+ * -r prints the optimal segmentation for every C from lo to hi instead of
+ * solving for the C given in the input.
+ * -k prints the best fit with exactly k lines for every k up to K instead;
+ * with -a the fit may use at most k lines. With -l only the fit for K
+ * lists its breakpoints.
+ * -w reads the points as a stream in x order and writes the segments to
+ * the output as they become final, keeping at most cap candidates and
+ * nodes (0 for no limit); the summary goes to the error output.
+ * -b solves every series of a text or binary batch file (see Batch) on
+ * threads threads and writes the results to the columnar file results
+ * (default batch.out); -x also saves the series as a binary batch file.
+ * -j writes the per-phase timings as JSON; build with -DPROFILE to record them.
+ */
 int main(int argc, char* argv[])
 {
     SLS sls;
+    const char* report = nullptr;
+    double lo = 0, hi = -1;
+    int K = 0;
+    long long cap = -1;
+    const char *batch_in = nullptr, *batch_out = "batch.out", *batch_copy = nullptr;
+    bool at_most = false, speedup = false, incremental = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(not strcmp(argv[i], "-t") and i+1 < argc)
+            sls.threads = atoi(argv[++i]);
+        else if(not strcmp(argv[i], "-s"))
+            speedup = true;
+        else if(not strcmp(argv[i], "-l"))
+            sls.lean = true;
+        else if(not strcmp(argv[i], "-p"))
+            sls.prune = true;
+        else if(not strcmp(argv[i], "-i"))
+            incremental = true;
+        else if(not strcmp(argv[i], "-r") and i+2 < argc)
+            lo = atof(argv[i+1]), hi = atof(argv[i+2]), i += 2;
+        else if(not strcmp(argv[i], "-k") and i+1 < argc)
+            K = atoi(argv[++i]);
+        else if(not strcmp(argv[i], "-a"))
+            at_most = true;
+        else if(not strcmp(argv[i], "-w") and i+1 < argc)
+            cap = atoll(argv[++i]);
+        else if(not strcmp(argv[i], "-b") and i+1 < argc)
+            batch_in = argv[++i];
+        else if(not strcmp(argv[i], "-o") and i+1 < argc)
+            batch_out = argv[++i];
+        else if(not strcmp(argv[i], "-x") and i+1 < argc)
+            batch_copy = argv[++i];
+        else if(not strcmp(argv[i], "-j") and i+1 < argc)
+            report = argv[++i];
+    }
+    if(batch_in or cap >= 0)
+    {
+        if(batch_in)
+            batch(sls, batch_in, batch_out, batch_copy);
+        else
+            stream(size_t(cap));
+        save_report(report);
+        return 0;
+    }
     sls.read();
     clock_t t0 = clock();
+    auto w0 = std::chrono::steady_clock::now();
+    // Wall time since w0; clock() would add up the time of every thread.
+    auto elapsed = [&]{ return int(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - w0).count()); };
+    if(hi >= lo)
+    {
+        path(sls, lo, hi);
+        std::cout << "\nRunning time (path):                " << elapsed() << " ms\n";
+        save_report(report);
+        return 0;
+    }
+    if(K > 0)
+    {
+        fit(sls, K, at_most);
+        std::cout << "\nRunning time (fit):                 " << elapsed() << " ms\n";
+        save_report(report);
+        return 0;
+    }
     sls.compute();
     std::cout << "Minimum Penalty = " << sls.min_penalty << std::endl;
     std::cout << "Number of segments = " << sls.segments << std::endl;
     std::cout << "Multiplier C = " << sls.C << std::endl;
-    clock_t t1 = clock();
+    int ms = elapsed();
     std::cout << "\nRunning time (input):               " << int(1000 * t0 / CLOCKS_PER_SEC) << " ms";
-    std::cout << "\nRunning time (algo):                " << int(1000 * (t1 - t0) / CLOCKS_PER_SEC) << " ms\n";
+    std::cout << "\nRunning time (algo):                " << ms << " ms";
+    std::cout << "\nMode:                               " << (sls.lean or sls.prune ? "lean" : "tables");
+    std::cout << "\nThreads:                            " << sls.threads;
+    std::cout << "\nTable memory:                       " << sls.table_bytes << " bytes";
+    if(sls.prune)
+        std::cout << "\nPruned breakpoints:                 " << sls.pruned;
+    std::cout << "\nPeak memory (RSS):                  " << Profile::peak_rss() << " KB\n";
+    save_report(report);
+    if(incremental)
+        feed(sls);
+    if(speedup)
+        scaling(sls);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "profile.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/**
+ * Finds or registers a phase. Called once per PROFILE_SCOPE site.
+ * @param[in] name indicates the name of the phase.
+ * @return counters of the phase.
+ */
+Profile::Phase& Profile::phase(const char* name)
+{
+    int n = used;
+    for(int i = 0; i < n; ++i)
+        if(not strcmp(phases[i].name, name))
+            return phases[i];
+    int id = used++;
+    if(id >= _MAX_PHASES)
+        abort();
+    phases[id].name = name, phases[id].id = id;
+    return phases[id];
+}
+
+/**
+ * @return peak resident set size of the process so far, in kilobytes.
+ */
+long Profile::peak_rss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if(not GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return long(pmc.PeakWorkingSetSize / 1024);
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return long(ru.ru_maxrss / 1024);
+#else
+    return long(ru.ru_maxrss);
+#endif
+#endif
+}
+
+/**
+ * Writes the counters of every phase as a JSON object.
+ * @param[in] out indicates the stream to be written.
+ * @param[in] tool indicates the name of the program being profiled.
+ */
+void Profile::report(std::ostream& out, const char* tool)
+{
+#ifdef PROFILE
+    bool enabled = true;
+#else
+    bool enabled = false;
+#endif
+    out << "{\n  \"tool\": \"" << tool << "\",\n  \"enabled\": " << (enabled ? "true" : "false");
+    out << ",\n  \"peak_rss_kb\": " << peak_rss() << ",\n  \"phases\": [";
+    int n = used;
+    for(int i = 0; i < n; ++i)
+    {
+        Phase& p = phases[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << p.name << "\", \"calls\": " << p.calls;
+        out << ", \"wall_ms\": " << p.nanos / 1e6 << ", \"allocations\": " << p.allocs;
+        out << ", \"peak_rss_kb\": " << p.peak_rss << '}';
+    }
+    out << (n ? "\n  ]\n}\n" : "]\n}\n");
+}
+
+#ifdef PROFILE
+/**
+ * Replaces the global allocation functions to count the heap
+ * allocations of each thread.
+ */
+void* operator new(size_t size)
+{
+    ++Profile::allocations;
+    if(void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+#endif
@@ -0,0 +1,94 @@
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+/**
+ * Per-phase instrumentation, compiled in only when PROFILE is defined
+ * (e.g. g++ -DPROFILE ...). A phase is a named block of code marked with
+ * PROFILE_SCOPE("name"); for each phase the wall time, the number of
+ * calls, the number of heap allocations and the peak resident set size
+ * seen when it ended are recorded. Times and allocations are inclusive
+ * of nested phases, and a recursive phase is only timed at its outermost
+ * call on each thread. Without PROFILE the macro expands to nothing and
+ * the report lists no phases.
+ */
+class Profile
+{
+public:
+    /**
+     * Counters of one phase, shared by all threads. Phases only live in
+     * static storage, so every counter starts at zero.
+     */
+    class Phase
+    {
+    public:
+        const char* name;
+        int id;
+        std::atomic<long long> calls, nanos, allocs;
+        std::atomic<long> peak_rss; ///< In kilobytes.
+    };
+
+private:
+    static const int _MAX_PHASES = 32; ///< Number of distinct phases supported.
+    static const long long _RSS_PERIOD = 1000000; ///< Nanoseconds between two RSS samples of a thread.
+    inline static Phase phases[_MAX_PHASES];
+    inline static std::atomic<int> used{0};
+    inline static thread_local int depth[_MAX_PHASES];
+    inline static thread_local long long last_rss;
+
+    static long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+public:
+    inline static thread_local long long allocations; ///< Heap allocations made by this thread.
+
+    static Phase& phase(const char*);
+    static long peak_rss();
+    static void report(std::ostream&, const char*);
+
+    /**
+     * Records one call of a phase for as long as it is alive.
+     */
+    class Scope
+    {
+        Phase& phase;
+        long long start, allocs;
+
+    public:
+        explicit Scope(Phase& p) : phase(p), start(0), allocs(0)
+        {
+            ++phase.calls;
+            if(depth[phase.id]++ == 0)
+                start = now(), allocs = allocations;
+        }
+
+        ~Scope()
+        {
+            if(--depth[phase.id])
+                return;
+            long long end = now();
+            phase.nanos += end - start;
+            phase.allocs += allocations - allocs;
+            if(end - last_rss >= _RSS_PERIOD or phase.peak_rss == 0)
+            {
+                last_rss = end;
+                long rss = peak_rss(), seen = phase.peak_rss;
+                while(rss > seen and not phase.peak_rss.compare_exchange_weak(seen, rss));
+            }
+        }
+    };
+};
+
+#ifdef PROFILE
+#define PROFILE_CONCAT(a, b) a##b
+#define PROFILE_NAME(a, b) PROFILE_CONCAT(a, b)
+#define PROFILE_SCOPE(name) \
+    static Profile::Phase& PROFILE_NAME(_phase, __LINE__) = Profile::phase(name); \
+    Profile::Scope PROFILE_NAME(_scope, __LINE__)(PROFILE_NAME(_phase, __LINE__))
+#else
+#define PROFILE_SCOPE(name)
+#endif
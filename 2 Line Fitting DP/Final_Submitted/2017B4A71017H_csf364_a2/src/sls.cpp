@@ -1,6 +1,10 @@
 #include "sls.hpp"
+#include "profile.hpp"
+#include "argmin.hpp"
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <map>
 #include <fstream>
 
 /**
@@ -31,13 +35,98 @@ Line::Line(double m, double c)
     this->c = c;
 }
 
+/**
+ * Constructor. Initializes the number hi + lo.
+ */
+Exact::Exact(double hi, double lo)
+{
+    this->hi = hi;
+    this->lo = lo;
+}
+
+/**
+ * Adds a and b, where |a| >= |b|, keeping the rounding error.
+ */
+static inline Exact quick_sum(double a, double b)
+{
+    double s = a + b;
+    return Exact(s, b - (s - a));
+}
+
+/**
+ * Adds a and b, keeping the rounding error.
+ */
+static inline Exact two_sum(double a, double b)
+{
+    double s = a + b, v = s - a;
+    return Exact(s, (a - (s - v)) + (b - v));
+}
+
+/**
+ * Adds two numbers. The low parts are added without their own rounding
+ * error, which leaves an error of about 2^-104 times the larger of the
+ * two, even when they cancel.
+ */
+Exact Exact::operator+(const Exact& b) const
+{
+    Exact s = two_sum(hi, b.hi);
+    return quick_sum(s.hi, s.lo + (lo + b.lo));
+}
+
+/**
+ * Subtracts two numbers, leaving the result unnormalized: lo may exceed
+ * half an ulp of hi, which the arithmetic of lse() allows for.
+ */
+Exact Exact::operator-(const Exact& b) const
+{
+    Exact s = two_sum(hi, -b.hi);
+    return Exact(s.hi, s.lo + (lo - b.lo));
+}
+
+/**
+ * Multiplies a and b exactly: the rounding error of the product is given
+ * by a fused multiply-add where the target has one, and otherwise by
+ * splitting a and b into halves of 26 bits (Dekker).
+ * @return the rounded product, with the rounding error in lo.
+ */
+Exact Exact::product(double a, double b)
+{
+    double p = a * b;
+#if defined(__FMA__)
+    return Exact(p, std::fma(a, b, -p));
+#else
+    const double split = 134217729.0; // 2^27 + 1
+    double ta = split * a, tb = split * b;
+    double ah = ta - (ta - a), al = a - ah;
+    double bh = tb - (tb - b), bl = b - bh;
+    return Exact(p, ((ah*bh - p) + ah*bl + al*bh) + al*bl);
+#endif
+}
+
+/**
+ * Takes (k*s - a*b) / k, where the two products nearly cancel. Both are
+ * formed exactly; where they are within a factor of 2 their difference
+ * is exact too (Sterbenz), so only the final steps round.
+ * @param[in] s indicates a sum of products of k values.
+ * @param[in] k indicates the number of values.
+ * @param[in] a indicates the sum of the first factors.
+ * @param[in] b indicates the sum of the second factors.
+ * @return the sum of products about the means.
+ */
+static inline double centred(const Exact& s, int k, const Exact& a, const Exact& b)
+{
+    Exact p = Exact::product(s.hi, k), q = Exact::product(a.hi, b.hi);
+    return ((p.hi - q.hi) + ((p.lo - q.lo) + (s.lo*k - a.hi*b.lo - a.lo*b.hi))) / k;
+}
+
 /**
  * This function initializes all the necessary values like the multiplier C.
- * Removes duplicates from the set of points and initializes the points.
- * Resize all the vectors with the total size that is n.
+ * Removes duplicates from the set of points and initializes the points
+ * and their prefix sums.
  */ 
 void SLS::init()
 {
+    PROFILE_SCOPE("init");
     std::sort(points.begin(), points.end());
     std::vector<Point> tmp;
     int cnt = 1;
@@ -51,54 +140,223 @@ void SLS::init()
     points.resize(n);
     for (int i = 0; i < n; i++)
         points[i] = tmp[i];
-    err.resize(n);
-    for(auto& it : err)
-        it.resize(n);
-    idx.resize(n);
-    lines.resize(n);
-    for(auto& it : lines)
-        it.resize(n);
+    moments();
 }
 
 /**
- * Computes the least squares error for the segment points[l] to points[r].
- * Stores the error for the segment in err[l][r].
- * Stores the best fit lines for the segment in lines[l][r].
+ * Computes the prefix sums of x, y, xy, xx and yy used by lse().
+ * The coordinates are first shifted to the middle point, which keeps
+ * the sums small, and the sums are kept as Exact: a segment of a few
+ * points far from the middle is the difference of two prefix sums much
+ * larger than its own, which plain doubles would leave mostly rounding.
+ */
+void SLS::moments()
+{
+    mx = points[n/2].x, my = points[n/2].y;
+    sx.assign(n+1, 0), sy.assign(n+1, 0);
+    sxx.assign(n+1, 0), sxy.assign(n+1, 0), syy.assign(n+1, 0);
+    for(int i = 0; i < n; ++i)
+    {
+        double x = points[i].x - mx, y = points[i].y - my;
+        sx[i+1] = sx[i] + x;
+        sy[i+1] = sy[i] + y;
+        sxx[i+1] = sxx[i] + Exact::product(x, x);
+        sxy[i+1] = sxy[i] + Exact::product(x, y);
+        syy[i+1] = syy[i] + Exact::product(y, y);
+    }
+}
+
+/**
+ * @param[in] work indicates the number of segment errors to be computed.
+ * @return number of blocks to split the work into: one without workers or
+ * for little work, otherwise a few per thread so that idle threads can
+ * steal the rest.
+ */
+int SLS::blocks(long long work) const
+{
+    if (not workers)
+        return 1;
+    return int(std::max(1LL, std::min(4LL * workers->size(), work / _GRAIN)));
+}
+
+/**
+ * Splits the range begin to end-1 into consecutive blocks of about the
+ * same size and calls fn(block, from, to) for each block [from, to) on the
+ * thread pool, returning once all of them have finished.
+ * @param[in] begin indicates the first index.
+ * @param[in] end indicates one past the last index.
+ * @param[in] count indicates the number of blocks, as given by blocks().
+ * @param[in] fn indicates the work on one block.
+ */
+void SLS::parallel(int begin, int end, int count, const std::function<void(int, int, int)>& fn)
+{
+    auto edge = [&](int b)
+    {
+        return begin + int((long long)(end - begin) * b / count);
+    };
+    std::vector<std::unique_ptr<ThreadPool::Task>> tasks;
+    for(int b = 1; b < count; ++b)
+    {
+        tasks.emplace_back(new ThreadPool::Task([&, b]{ fn(b, edge(b), edge(b+1)); }));
+        workers->spawn(*tasks.back());
+    }
+    fn(0, edge(0), edge(1));
+    for(auto& task : tasks)
+        workers->wait(*task);
+}
+
+/**
+ * Computes the least squares error and best fit line for the segment
+ * points[l] to points[r] in O(1) from the prefix sums built by moments().
+ * The sums about the mean of the segment are taken in Exact arithmetic,
+ * so only the last steps round: the error comes out within a few ulps of
+ * the sum of squares of the centred y about their mean over all points,
+ * which bounds the error of every segment.
  * @param[in] l indicates the leftmost point in the segment.
  * @param[in] r indicates the rightmost point in the segment.
+ * @param[out] error receives the least squares error of the segment.
+ * @return the best fit line of the segment.
  */
-void SLS::lse(int l, int r)
+Line SLS::lse(int l, int r, double& error) const
 {
     int k = r - l + 1;
-    double x = 0, y = 0, xy = 0, xx = 0;
-    for(int i = l; i <= r; i++)
+    Exact sumx = sx[r+1] - sx[l], sumy = sy[r+1] - sy[l];
+    // Sums of squares and products about the mean of the segment.
+    double xx = centred(sxx[r+1] - sxx[l], k, sumx, sumx);
+    double xy = centred(sxy[r+1] - sxy[l], k, sumx, sumy);
+    double yy = centred(syy[r+1] - syy[l], k, sumy, sumy);
+    double x = sumx.hi, y = sumy.hi;
+    double m = inf, c = x/k + mx;
+    error = std::max(xx, 0.0);
+    // Points are sorted by x, so the segment is vertical exactly when its ends are.
+    if (points[l].x != points[r].x)
     {
-        x += points[i].x;
-        y += points[i].y;
-        xy += (points[i].x * points[i].y);
-        xx += (points[i].x * points[i].x);
+        m = xy / xx;
+        c = (y - m*x) / k + my - m*mx;
+        error = yy - m*xy;
     }
-    double t1 = k * xy;
-    double t2 = x * y;
-    double t3 = k * xx;
-    double t4 = x * x;
-    double m = inf, c = x / k;
-    if (t3 != t4)
+    if (error < 0.000001) error = 0;
+    return Line(m, c);
+}
+
+/**
+ * @return whether the errors and lines of all segments are stored in err
+ * and lines. The pruned DP reads few of them, so #prune implies #lean.
+ */
+bool SLS::stored() const
+{
+    return not lean and not prune;
+}
+
+/**
+ * @param[in] l indicates the leftmost point in the segment.
+ * @param[in] r indicates the rightmost point in the segment.
+ * @return least squares error of the segment, from err unless in lean mode.
+ */
+double SLS::cost(int l, int r) const
+{
+    if (stored())
+        return err[r][l];
+    double error;
+    lse(l, r, error);
+    return error;
+}
+
+/**
+ * Runs the same DP as sls() but keeps a list of candidate breakpoints and
+ * permanently drops those that can no longer be optimal (PELT). Splitting
+ * a segment never increases its least squares error, so a breakpoint whose
+ * cost up to point t already exceeds dp[t] loses to t at every later point
+ * that can close a segment after t, which is from t+2 on. The segmentation
+ * and penalty are the same as without pruning, as a breakpoint is dropped
+ * only by a margin over the rounding: no segment has an error above Q, the
+ * sum of squares of y about their mean, lse() gets each within a few ulps
+ * of Q, and clamping small errors to 0 moves one by less than 1e-6. The
+ * dominance involves three errors and sums of penalties within a few ulps
+ * of Q + C + dp, so 1e-6 and 64 ulps of those cover it.
+ * @returns The minimum penalty which is stored in dp[n].
+ */
+double SLS::pelt()
+{
+    std::vector<int> cand, dead; // Breakpoints, and the step at which each was dominated.
+    std::vector<double> reach;
+    const double ulps = 64 * std::numeric_limits<double>::epsilon();
+    double total = centred(syy[n], n, sy[n], sy[n]);
+    dp[1] = inf, idx[0] = 0;
+    for(int j = 2; j <= n; ++j)
     {
-        m = (t1 - t2) / (t3 - t4);
-        c = (y - m*x) / k;
+        cand.push_back(j-2), dead.push_back(n+1), reach.push_back(0);
+        double val = inf;
+        int ind = 0, k = 0;
+        for(int i = 0; i < int(cand.size()); ++i)
+        {
+            if (dead[i] <= j-2)
+            {
+                ++pruned;
+                continue;
+            }
+            int t = cand[i];
+            double e = cost(t, j-1);
+            if(e + C + dp[t] < val)
+                val = e + C + dp[t], ind = t+1;
+            cand[k] = t, dead[k] = dead[i], reach[k] = e + dp[t], ++k;
+        }
+        cand.resize(k), dead.resize(k), reach.resize(k);
+        dp[j] = val;
+        idx[j-1] = ind-1;
+        double margin = 1e-6 + ulps * (total + std::abs(C) + std::abs(val));
+        for(int i = 0; i < k; ++i)
+            if (dead[i] > n and reach[i] * (1 - ulps) > val + margin)
+                dead[i] = j;
     }
-    double error = 0;
-    for(int i = l; i <= r; i++)
+    return dp[n];
+}
+
+/**
+ * Prepares the DP for the current set of points. Unless #lean or #prune is set,
+ * the errors and lines of all segments are stored in err and lines;
+ * otherwise each error is computed when the DP needs it and only O(n)
+ * memory is used. The tables do not depend on C and serve every later
+ * call of solve().
+ */
+void SLS::fill()
+{
+    idx.assign(n, 0);
+    dp.clear(), chain.clear(), on_chain.assign(n, 0);
+    if (threads <= 1)
+        workers.reset();
+    else if (not workers or workers->size() != threads)
+        workers.reset(new ThreadPool(threads));
+    pruned = 0;
+    table_bytes = n * sizeof(int) + 5 * (n+1) * sizeof(Exact) + (n+1) * sizeof(double);
+    if (not stored() or n == 1)
     {
-        x = points[i].x, y = points[i].y;
-        double e = x - c;
-        if (m != inf) e = y - m*x - c;
-        error += e*e;
+        err.clear(), lines.clear();
+        return;
     }
-    if (error < 0.000001) error = 0;
-    err[l][r] = error;
-    lines[l][r] = Line(m, c);
+    PROFILE_SCOPE("lse fill");
+    // Rows left from an earlier computation keep their memory for this one.
+    err.resize(n), lines.resize(n);
+    table_bytes += size_t(n) * (n-1) / 2 * (sizeof(double) + sizeof(Line));
+    // Rows get longer as j grows, so the blocks are cut by the work before them.
+    int count = blocks((long long)n * n / 2);
+    std::vector<int> first(count+1, n);
+    for(int j = 0, b = 0; j < n and b <= count; ++j)
+        while (b <= count and (long long)j * j >= (long long)n * n * b / count)
+            first[b++] = j;
+    auto rows = [&](int b, int, int)
+    {
+        for(int j = first[b]; j < first[b+1]; ++j)
+        {
+            err[j].resize(j), lines[j].resize(j);
+            for(int i = 0; i < j; ++i)
+                lines[j][i] = lse(i, j, err[j][i]);
+        }
+    };
+    if (count == 1)
+        rows(0, 0, n);
+    else
+        parallel(0, count, count, rows);
 }
 
 /**
@@ -108,30 +366,171 @@ void SLS::lse(int l, int r)
  */
 double SLS::sls()
 {
-    if (n == 1) return 0;
-    std::vector<double> dp(n+1);
-    for(int i = 0; i < n; ++i)
-        for(int j = i+1; j < n; ++j)
-            lse(i, j);
-    for(int j = 1; j <= n; ++j)
+    fill();
+    return solve();
+}
+
+/**
+ * Runs the DP of sls() for the current C over the tables built by fill().
+ * The errors of the segments ending at j are contiguous in err[j-1], or
+ * are computed into col in lean mode, and the minimum over them is found
+ * by the vectorized argmin(). With #threads > 1 the minimum for each j is
+ * found over blocks of i in parallel, and the blocks are combined in
+ * order, keeping the first strict minimum, so idx is the same as with one
+ * thread and with the scalar loop.
+ * @returns The minimum penalty which is stored in dp[n].
+ */
+double SLS::solve()
+{
+    dp.assign(n+1, 0);
+    if (n == 1)
     {
-        double val = inf;
-        int ind;
-        for(int i = 1; i < j; i++)
-            if(err[i-1][j-1] + C + dp[i-1] < val)
-                val = err[i-1][j-1] + C + dp[i-1], ind = i;
-        dp[j] = val;
-        idx[j-1] = ind-1;
+        dp[1] = inf;
+        return 0;
     }
+    PROFILE_SCOPE("dp");
+    if (prune)
+        return pelt();
+    std::vector<double> col(stored() ? 0 : n);
+    dp[1] = inf, idx[0] = 0;
+    for(int j = 2; j <= n; ++j)
+        extend(j, col);
     return dp[n];
 }
 
+/**
+ * Finds dp[j] and idx[j-1] from dp[0] to dp[j-1], as one step of solve().
+ * @param[in] j indicates the number of points in the prefix.
+ * @param[out] col receives the errors of the segments ending at point j-1
+ * in lean mode; it has at least j-1 elements.
+ */
+void SLS::extend(int j, std::vector<double>& col)
+{
+    // Minimum over the segments i to j starting at from to to-1.
+    auto scan = [&](int from, int to, double& val)
+    {
+        const double* e = stored() ? err[j-1].data() : col.data();
+        if (not stored())
+            for(int i = from; i < to; ++i)
+                col[i-1] = cost(i-1, j-1);
+        return argmin(e + from-1, dp.data() + from-1, C, to - from, val) + from;
+    };
+    double val = inf;
+    int ind = 0;
+    int count = blocks(j-1);
+    if (count > 1)
+    {
+        std::vector<double> vals(count, inf);
+        std::vector<int> inds(count, 0);
+        parallel(1, j, count, [&](int b, int from, int to)
+        {
+            inds[b] = scan(from, to, vals[b]);
+        });
+        for(int b = 0; b < count; ++b)
+            if(vals[b] < val)
+                val = vals[b], ind = inds[b];
+    }
+    else
+        ind = scan(1, j, val);
+    dp[j] = val;
+    idx[j-1] = ind-1;
+}
+
+/**
+ * Brings chain up to date with idx after points were appended. The
+ * optimal segmentation of the new prefix is followed back from its last
+ * point only until it meets chain, since from there on both are the
+ * same; the cost is the number of segments that changed.
+ */
+void SLS::trace()
+{
+    on_chain.resize(n, 0);
+    std::vector<int> fresh;
+    int j = n > 1 ? n-1 : -1;
+    for(; j >= 0 and not on_chain[j]; j = idx[j]-1)
+        fresh.push_back(j);
+    while (not chain.empty() and chain.back() != j)
+        on_chain[chain.back()] = 0, chain.pop_back();
+    for(auto it = fresh.rbegin(); it != fresh.rend(); ++it)
+        chain.push_back(*it), on_chain[*it] = 1;
+    segments = int(chain.size());
+}
+
+/**
+ * Adds a point to the right of all current points and updates the
+ * solution for the current C. The DP of the earlier prefixes does not
+ * change, so only the prefix sums, the errors of the segments ending at
+ * the new point (stored unless #lean or #prune is set) and dp[n] are
+ * computed, in O(n); the segmentation is then updated by trace().
+ * #min_penalty and #segments hold the new solution. Changing C, #lean or
+ * #prune needs a compute() before further appends.
+ * @param[in] x indicates the x-coordinate of the point.
+ * @param[in] y indicates the y-coordinate of the point.
+ * @return whether the point was taken; a point that comes before the last
+ * one is rejected, and one equal to it is dropped like a duplicate.
+ */
+bool SLS::append(double x, double y)
+{
+    PROFILE_SCOPE("append");
+    if (n > 0)
+    {
+        Point& last = points[n-1];
+        if (x < last.x or (x == last.x and y < last.y))
+            return false;
+        if (x == last.x and y == last.y)
+            return true;
+        if (dp.size() != size_t(n+1))
+            sls();
+    }
+    else
+    {
+        points.clear();
+        mx = x, my = y;
+        sx.assign(1, 0), sy.assign(1, 0);
+        sxx.assign(1, 0), sxy.assign(1, 0), syy.assign(1, 0);
+        fill();
+        dp.assign(1, 0);
+    }
+    points.push_back(Point(x, y));
+    x -= mx, y -= my;
+    sx.push_back(sx[n] + x);
+    sy.push_back(sy[n] + y);
+    sxx.push_back(sxx[n] + Exact::product(x, x));
+    sxy.push_back(sxy[n] + Exact::product(x, y));
+    syy.push_back(syy[n] + Exact::product(y, y));
+    ++n;
+    // Shifting to the first point loses accuracy as the points drift away
+    // from it; shifting again to the middle whenever n doubles costs O(1)
+    // per append.
+    if ((n & (n-1)) == 0)
+        moments();
+    idx.push_back(0), dp.push_back(inf);
+    table_bytes += sizeof(int) + 5 * sizeof(Exact) + sizeof(double);
+    if (stored())
+    {
+        err.emplace_back(n-1), lines.emplace_back(n-1);
+        for(int i = 0; i < n-1; ++i)
+            lines[n-1][i] = lse(i, n-1, err[n-1][i]);
+        table_bytes += (n-1) * (sizeof(double) + sizeof(Line));
+    }
+    min_penalty = 0;
+    if (n > 1)
+    {
+        std::vector<double> col(stored() ? 0 : n);
+        extend(n, col);
+        min_penalty = dp[n];
+    }
+    trace();
+    return true;
+}
+
 /**
  * Reads n number of points (x, y).
  * Calls the init function to initialise and resize necessary attributes.
  */
 void SLS::read()
 {
+    PROFILE_SCOPE("read");
     std::cin >> n >> C;
     points.resize(n);
     for(auto& it : points)
@@ -139,27 +538,311 @@ void SLS::read()
     init();
 }
 
+/**
+ * @return the points, sorted and without duplicates.
+ */
+const std::vector<Point>& SLS::get_points() const
+{
+    return points;
+}
+
+/**
+ * Takes a new set of points instead of reading them, as read() does.
+ * Memory held from earlier computations is kept for reuse.
+ * @param[in] pts indicates the points, in any order; there must be at least one.
+ * @param[in] multiplier indicates the cost multiplier C.
+ */
+void SLS::assign(const std::vector<Point>& pts, double multiplier)
+{
+    n = int(pts.size());
+    C = multiplier;
+    points.assign(pts.begin(), pts.end());
+    init();
+}
+
+/**
+ * Computes #min_penalty and #segments without writing anything.
+ */
+void SLS::run()
+{
+    min_penalty = sls();
+    trace();
+}
+
+/**
+ * Collects the segments of the last computation, fitting their lines in
+ * lean mode.
+ * @param[out] out receives the segments by increasing x.
+ */
+void SLS::get_segments(std::vector<Segment>& out) const
+{
+    PROFILE_SCOPE("backtrack");
+    out.clear();
+    for(int j : chain)
+    {
+        Segment seg;
+        double e;
+        seg.line = stored() ? lines[j][idx[j]] : lse(idx[j], j, e);
+        seg.start = points[idx[j]].x, seg.stop = points[j].x;
+        if (seg.line.m == inf) seg.start = points[idx[j]].y, seg.stop = points[j].y;
+        out.push_back(seg);
+    }
+}
+
 /**
  * Computes the minimum penalty by calling the sls() function.
  * Writes the output (multiple best fit lines obtained) to a file for visualization.
+ * In lean mode the lines of the chosen segments are fitted here.
  */
 void SLS::compute()
 {
-    min_penalty = sls();
+    run();
     std::ofstream file;
     file.open("..\\output\\out.txt");
     file << min_penalty << ' ' << C << '\n';
-    segments = 0;
+    std::vector<Segment> segs;
+    get_segments(segs);
+    for(auto it = segs.rbegin(); it != segs.rend(); ++it)
+        file << it->line.m << ' ' << it->line.c << ' ' << it->start << ' ' << it->stop << '\n';
+    file.close();
+}
+
+/**
+ * Runs the DP for the current C and collects the chosen segmentation.
+ * @return the segmentation, with its range of C left unset.
+ */
+Piece SLS::segmentation()
+{
+    Piece out;
+    solve();
+    out.segments = 0, out.error = 0;
     if (n > 1)
     {
         for(int j = n-1; j >= 0; j = idx[j]-1)
         {
-            double m = lines[idx[j]][j].m, c = lines[idx[j]][j].c;
-            double start = points[idx[j]].x, stop = points[j].x;
-            if (m == inf) start = points[idx[j]].y, stop = points[j].y;
-            file << m << ' ' << c << ' ' << start << ' ' << stop << '\n';
-            segments++;
+            out.error += cost(idx[j], j), out.segments++;
+            if (idx[j] > 0)
+                out.breaks.push_back(points[idx[j]].x);
         }
     }
-    file.close();
-}
\ No newline at end of file
+    std::reverse(out.breaks.begin(), out.breaks.end());
+    return out;
+}
+
+/**
+ * Finds the optimal segmentation for every C in [lo, hi] with the CROPS
+ * search: the DP is run at both ends, and for two segmentations that
+ * differ by more than one segment it is run again at the C where their
+ * penalties are equal. Either that run finds a new segmentation between
+ * them, which splits the range, or the two meet there. This needs about
+ * twice as many DP runs as there are segmentations, and the tables of
+ * fill() are built once for all of them.
+ * @param[in] lo indicates the smallest C.
+ * @param[in] hi indicates the largest C.
+ * @return the segmentations by increasing C, each with the range of C
+ * over which it is optimal.
+ */
+std::vector<Piece> SLS::path(double lo, double hi)
+{
+    PROFILE_SCOPE("path");
+    if (lo > hi)
+        std::swap(lo, hi);
+    double multiplier = C;
+    fill();
+    std::map<int, Piece> found;
+    auto run = [&](double c)
+    {
+        C = c;
+        Piece piece = segmentation();
+        found.emplace(piece.segments, piece);
+        return piece;
+    };
+    std::vector<std::pair<Piece, Piece>> todo;
+    todo.push_back({run(lo), run(hi)});
+    while (not todo.empty())
+    {
+        auto [a, b] = todo.back();
+        todo.pop_back();
+        if (a.segments <= b.segments + 1)
+            continue;
+        double c = (b.error - a.error) / (a.segments - b.segments);
+        Piece piece = run(c);
+        double meet = b.error + c * b.segments;
+        if (piece.error + c * piece.segments < meet - 1e-9 * (std::abs(meet) + 1))
+            todo.push_back({a, piece}), todo.push_back({piece, b});
+    }
+    C = multiplier;
+    dp.clear();
+
+    // Lower envelope of the lines error + C * segments, by decreasing segments.
+    auto cross = [](const Piece& a, const Piece& b)
+    {
+        return (b.error - a.error) / (a.segments - b.segments);
+    };
+    std::vector<Piece> out;
+    for (auto it = found.rbegin(); it != found.rend(); ++it)
+    {
+        while (out.size() >= 2 and cross(out[out.size()-2], it->second) <= cross(out[out.size()-2], out.back()))
+            out.pop_back();
+        out.push_back(it->second);
+    }
+    out.front().lo = lo, out.back().hi = hi;
+    for (size_t i = 0; i+1 < out.size(); ++i)
+        out[i].hi = out[i+1].lo = cross(out[i], out[i+1]);
+    return out;
+}
+
+/**
+ * Adds one segment to the best segmentations of the prefixes of the
+ * points l to r-1: cur[j] receives the least error of splitting the first
+ * j points into k segments, given the same for k-1 segments in prev.
+ * Backwards, the points are taken from r-1 down to l, so that cur[j]
+ * covers the last j points instead. Every segment has at least 2 points.
+ * The least squares error does not keep the best breakpoint moving right
+ * as j grows, so every breakpoint is tried, in O(m^2) for m points.
+ * @param[in] prev indicates the least errors with k-1 segments.
+ * @param[out] cur receives the least errors with k segments.
+ * @param[in] k indicates the number of segments.
+ * @param[in] l indicates the first point.
+ * @param[in] r indicates one past the last point.
+ * @param[in] backward indicates whether the points are taken in reverse.
+ * @param[out] from receives, unless it is nullptr, the number of points
+ * before the last segment of the best split of the first j points, for
+ * every j that can be split.
+ */
+void SLS::layer(const std::vector<double>& prev, std::vector<double>& cur, int k, int l, int r, bool backward, std::vector<int>* from) const
+{
+    int m = r - l;
+    auto error = [&](int t, int j)
+    {
+        return backward ? cost(r-j, r-1-t) : cost(l+t, l+j-1);
+    };
+    cur.assign(m+1, inf);
+    if (from)
+        from->assign(m+1, 0);
+    for(int j = 2*k; j <= m; ++j)
+    {
+        int at = 0;
+        for(int t = 2*k-2; t <= j-2; ++t)
+        {
+            double e = prev[t] + error(t, j);
+            if(e < cur[j])
+                cur[j] = e, at = t;
+        }
+        if (from)
+            (*from)[j] = at;
+    }
+}
+
+/**
+ * @param[in] l indicates the first point.
+ * @param[in] r indicates one past the last point.
+ * @param[in] k indicates the number of segments.
+ * @param[in] backward indicates whether the points are taken in reverse.
+ * @return least errors of splitting the first (or last) j points of l to
+ * r-1 into k segments, for every j. Only two rows are kept.
+ */
+std::vector<double> SLS::layers(int l, int r, int k, bool backward) const
+{
+    std::vector<double> prev(r-l+1, inf), cur;
+    prev[0] = 0;
+    for(int i = 1; i <= k; ++i)
+        layer(prev, cur, i, l, r, backward, nullptr), prev.swap(cur);
+    return prev;
+}
+
+/**
+ * Finds the breakpoints of the best split of the points l to r-1 into k
+ * segments in O(n) memory (Hirschberg): the best splits of every prefix
+ * into k/2 segments and of every suffix into the rest meet at the best
+ * middle breakpoint, and both halves are split the same way.
+ * @param[in] l indicates the first point.
+ * @param[in] r indicates one past the last point.
+ * @param[in] k indicates the number of segments.
+ * @param[out] cuts receives the first point of every segment after the first, in order.
+ */
+void SLS::split(int l, int r, int k, std::vector<int>& cuts) const
+{
+    if (k <= 1)
+        return;
+    int h = k / 2, at = l + 2*h;
+    {
+        std::vector<double> head = layers(l, r, h, false), tail = layers(l, r, k-h, true);
+        double val = inf;
+        for(int s = l + 2*h; s <= r - 2*(k-h); ++s)
+        {
+            if(head[s-l] + tail[r-s] < val)
+                val = head[s-l] + tail[r-s], at = s;
+        }
+    }
+    split(l, at, h, cuts);
+    cuts.push_back(at);
+    split(at, r, k-h, cuts);
+}
+
+/**
+ * Finds the best fit with exactly k lines, or with at most k lines, for
+ * every k up to K, instead of pricing each segment at C. The errors of all
+ * k come from one DP over the number of segments that keeps two rows of
+ * errors. With the tables of fill() the best breakpoint of every prefix is
+ * also kept for every k, in K rows of n, which is less than the tables
+ * hold, and every fit is traced back from them. In #lean mode only O(n)
+ * memory is used: the other fits report their error alone, and the
+ * breakpoints of the K-th fit are recovered by split(), which costs about
+ * as much as the DP.
+ * @param[in] K indicates the largest number of segments. No more than n/2
+ * segments fit, as every segment has at least 2 points.
+ * @param[in] at_most indicates whether the k-th fit may use fewer than k segments.
+ * @return the fits for k = 1 to K, by increasing k.
+ */
+std::vector<Piece> SLS::fit(int K, bool at_most)
+{
+    PROFILE_SCOPE("fit");
+    fill();
+    std::vector<Piece> out;
+    if (n == 1)
+        return out;
+    K = std::min(K, n / 2);
+    std::vector<std::vector<int>> from(stored() ? K+1 : 0);
+    // Fills in the error and breakpoints of a fit from the first point of every segment after the first.
+    auto describe = [&](Piece& piece, std::vector<int>& cuts)
+    {
+        piece.error = 0, piece.breaks.clear();
+        cuts.push_back(n);
+        for(int i = 0, t = 0; i < piece.segments; t = cuts[i++])
+        {
+            piece.error += cost(t, cuts[i]-1);
+            if (t > 0)
+                piece.breaks.push_back(points[t].x);
+        }
+    };
+    std::vector<double> prev(n+1, inf), cur;
+    prev[0] = 0;
+    for(int k = 1; k <= K; ++k)
+    {
+        layer(prev, cur, k, 0, n, false, stored() ? &from[k] : nullptr), prev.swap(cur);
+        if (at_most and k > 1 and out.back().error <= prev[n])
+        {
+            out.push_back(out.back());
+            continue;
+        }
+        Piece piece;
+        piece.lo = piece.hi = 0;
+        piece.segments = k, piece.error = prev[n];
+        if (stored())
+        {
+            std::vector<int> cuts(k-1);
+            for(int i = k, j = n; i > 1; --i)
+                cuts[i-2] = j = from[i][j];
+            describe(piece, cuts);
+        }
+        out.push_back(piece);
+    }
+    if (not stored() and not out.empty())
+    {
+        std::vector<int> cuts;
+        split(0, n, out.back().segments, cuts);
+        describe(out.back(), cuts);
+    }
+    return out;
+}
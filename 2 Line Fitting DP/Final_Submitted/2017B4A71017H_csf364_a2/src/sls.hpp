@@ -1,5 +1,11 @@
 #include <vector>
+#include <cstdint>
 #include <limits>
+#include <memory>
+#include <cstddef>
+#include <ostream>
+#include <functional>
+#include "thread_pool.hpp"
 
 /**
  * Represents a point (x, y) in 2-D plane.
@@ -25,6 +31,46 @@ public:
     Line(double, double);
 };
 
+/**
+ * Represents a double-double number hi + lo, where lo holds what rounding
+ * dropped from hi, for about 106 bits of precision. The prefix sums of
+ * SLS are kept this way, so that the sums over a short segment, taken as
+ * the difference of two large prefix sums, keep their own precision.
+ */
+class Exact
+{
+public:
+    double hi, lo;
+    Exact(double = 0, double = 0);
+    inline Exact operator+(const Exact&) const;
+    inline Exact operator-(const Exact&) const;
+    inline static Exact product(double, double);
+};
+
+/**
+ * Represents one segment of a segmentation, as written by SLS::compute().
+ */
+class Segment
+{
+public:
+    Line line; ///< Best fit line of the segment.
+    double start, stop; ///< x-coordinates of the ends of the segment, or y-coordinates if it is vertical.
+};
+
+/**
+ * Represents the optimal segmentation over a range of the multiplier C,
+ * as found by SLS::path(), or for a number of segments, as found by
+ * SLS::fit().
+ */
+class Piece
+{
+public:
+    double lo, hi; ///< Range of C over which the segmentation is optimal. Both are 0 from SLS::fit().
+    int segments; ///< Number of segments.
+    double error; ///< Total least squares error; the penalty at C is error + C * segments.
+    std::vector<double> breaks; ///< x-coordinate of the first point of every segment after the first.
+};
+
 /**
  * Implements the Segmented Least Squares Algorithm to solve the 
  * line fitting problem of finding (multiple) best fit lines.
@@ -32,21 +78,203 @@ public:
 class SLS
 {
     static constexpr double inf = std::numeric_limits<double>::infinity(); ///< Represents infinity.
-    int n; ///< Number of points in the plane.
+    static const int _GRAIN = 4096; ///< Fewest segment errors worth handing to another thread.
+    int n = 0; ///< Number of points in the plane.
     std::vector<Point> points; ///< list of all the points.
-    std::vector<std::vector<double>> err; ///< Stores the least squares error err[i][j] for the segment points[i] to points[j].
+    std::vector<std::vector<double>> err; ///< Stores the least squares error err[j][i] for the segment points[i] to points[j], i < j, so that the DP for j reads err[j] in order. Empty in lean mode.
+    std::vector<double> dp; ///< dp[j] is the minimum penalty of the first j points, kept for append().
+    std::vector<int> chain; ///< Last point of every segment of the optimal segmentation, by increasing x.
+    std::vector<char> on_chain; ///< Whether each point is the last of a segment in chain.
     std::vector<int> idx; ///< idx[i] represents the index of the point such that the segment from idx[i] to i is included in the optimal answer.
-    std::vector<std::vector<Line>> lines; ///< Stores the best fit lines lines[i][j] for the segment points[i] to points[j].
+    std::vector<std::vector<Line>> lines; ///< Stores the best fit lines lines[j][i] for the segment points[i] to points[j], i < j. Empty in lean mode.
+    std::unique_ptr<ThreadPool> workers; ///< Shares the work of fill() and solve() out when #threads > 1.
+    double mx, my; ///< Coordinates of the middle point, subtracted before summing.
+    std::vector<Exact> sx, sy, sxx, sxy, syy; ///< Prefix sums of the centred coordinates and their products; sx[i] sums points[0] to points[i-1].
 
     void init();
-    void lse(int, int);
+    int blocks(long long) const;
+    void parallel(int, int, int, const std::function<void(int, int, int)>&);
+    void moments();
+    Line lse(int, int, double&) const;
+    bool stored() const;
+    double cost(int, int) const;
+    double pelt();
+    void fill();
+    double solve();
+    void extend(int, std::vector<double>&);
+    void trace();
     double sls();
+    Piece segmentation();
+    void layer(const std::vector<double>&, std::vector<double>&, int, int, int, bool, std::vector<int>*) const;
+    std::vector<double> layers(int, int, int, bool) const;
+    void split(int, int, int, std::vector<int>&) const;
 
 public:
     double min_penalty; ///< The minimum penalty achieved using the algorithm.
     int segments; ///< The optimal number of segments in which the set of points are partitioned.
     double C; ///< The cost multiplier for partitioning into segments.
+    bool lean = false; ///< Whether segment errors are computed on demand instead of being stored in n x n tables.
+    size_t table_bytes; ///< Bytes held by the tables of the last computation.
+    bool prune = false; ///< Whether the DP drops breakpoints that can no longer be optimal. Implies #lean.
+    long long pruned; ///< Number of breakpoints dropped by the last computation.
+    int threads = 1; ///< Number of threads used to fill the tables and to run the DP without pruning.
     
     void read();
+    void assign(const std::vector<Point>&, double);
+    void run();
+    void get_segments(std::vector<Segment>&) const;
     void compute();
+    bool append(double, double);
+    const std::vector<Point>& get_points() const;
+    std::vector<Piece> path(double, double);
+    std::vector<Piece> fit(int, bool);
+};
+
+/**
+ * Segmented least squares over a stream of points that arrive in x order,
+ * in memory that does not grow with the stream. Only the breakpoints that
+ * can still be optimal are kept (pruned as in SLS::pelt()), each with the
+ * sums of the points after it, and the best splits of recent prefixes form
+ * a tree. Once every kept breakpoint descends from the same segment, that
+ * segment can no longer change and is written out. With #cap set, when
+ * more than #cap breakpoints and tree nodes are kept, all but the newest
+ * breakpoints are dropped (cut()), and if the tree is still too large the
+ * segmentation is ended at the newest point (restart()); each costs at
+ * most C over the optimum.
+ */
+class Stream
+{
+    static constexpr double inf = std::numeric_limits<double>::infinity(); ///< Represents infinity.
+
+    /**
+     * Best split of a prefix of the stream, stored as its last segment and
+     * the node of the prefix before that segment.
+     */
+    class Node
+    {
+    public:
+        long long t; ///< Number of points in the prefix.
+        int parent; ///< Node of the prefix before the last segment, or -1.
+        int kids; ///< Number of nodes whose parent this is.
+        int held; ///< Number of candidates, and #last, referring to this node.
+        double dp; ///< Minimum penalty of the prefix, less #base.
+        Line line; ///< Best fit line of the last segment.
+        double start, stop; ///< Ends of the last segment, as written by SLS::compute().
+    };
+
+    /**
+     * A breakpoint that can still start the segment ending at the newest point.
+     */
+    class Candidate
+    {
+    public:
+        int node; ///< Node of the prefix before the breakpoint.
+        long long dead; ///< Step at which it was dominated, or -1.
+        double reach; ///< Error of the segment plus the penalty before it, at the last step.
+        double x0, y0; ///< First point of the segment; the sums are taken relative to it.
+        double k, sx, sy, sxx, sxy, syy; ///< Number of points of the segment and sums over them.
+    };
+
+    std::vector<Node> nodes; ///< Tree of best splits; freed nodes are reused.
+    std::vector<int> unused; ///< Freed slots of nodes.
+    std::vector<Candidate> cands; ///< Live breakpoints, by increasing position.
+    int root = -1; ///< Node of the longest prefix whose segments have all been written.
+    int last = -1; ///< Node of the whole stream so far.
+    double base = 0; ///< Penalty of the prefix at #root, taken out of every dp.
+    double px, py; ///< Newest point.
+    bool single = false; ///< Whether the next segment may be a single point, right after a restart.
+    std::ostream& out; ///< Receives the segments as they become final.
+
+    int make(long long, int, double);
+    void release(int, bool);
+    Line fit(const Candidate&, double, double&) const;
+    void write(int);
+    void settle();
+    void cut();
+    void restart(int);
+
+public:
+    double C; ///< The cost multiplier for partitioning into segments.
+    size_t cap = 0; ///< Most candidates and nodes kept at once before the stream is cut; 0 for no limit.
+    long long points = 0; ///< Number of distinct points taken.
+    long long rejected = 0; ///< Number of points dropped for coming before the previous one.
+    long long segments = 0; ///< Number of segments written.
+    long long cuts = 0; ///< Number of times old breakpoints were dropped to respect #cap.
+    long long restarts = 0; ///< Number of times the segmentation was ended early to respect #cap.
+    size_t peak = 0; ///< Most candidates and nodes kept at once, after any cut.
+
+    Stream(std::ostream&, double);
+    bool push(double, double);
+    double finish();
+    size_t size() const;
+    double bound() const;
+};
+
+/**
+ * Solves many independent SLS problems, each a series of points with its
+ * own C, on a thread pool. Each thread reuses one SLS, and so the memory
+ * of its tables, for all the series it takes.
+ *
+ * Series are read from a text file, holding the number of series and then
+ * for each series its id, its number of points n, its C and n points; or
+ * from a binary file, holding a header (see Header, with magic "SLSB")
+ * and then for each series its id and n as int64, its C as a double and n
+ * points as pairs of doubles.
+ *
+ * Results are written column by column to a binary file: a header with
+ * magic "SLSR", the number of series s and the number of segments r; then
+ * the ids (int64) and minimum penalties (double) of the series in input
+ * order; the s+1 offsets (uint64) of the segments of each series into the
+ * segment columns; and the columns m, c, start and stop (double) of all
+ * r segments, by series and then by increasing x.
+ */
+class Batch
+{
+    /**
+     * Layout of the file headers.
+     */
+    class Header
+    {
+    public:
+        char magic[4];
+        uint32_t version;
+        uint64_t count; ///< Number of series.
+        uint64_t rows; ///< Number of segments in a result file, otherwise 0.
+    };
+
+    static const uint32_t _VERSION = 1; ///< Version written by save() and write().
+
+public:
+    /**
+     * One independent problem.
+     */
+    class Series
+    {
+    public:
+        long long id;
+        double C;
+        std::vector<Point> points;
+    };
+
+    /**
+     * Solution of one series.
+     */
+    class Result
+    {
+    public:
+        long long id;
+        double penalty;
+        std::vector<Segment> segments;
+    };
+
+    std::vector<Series> series; ///< Problems, in input order.
+    std::vector<Result> results; ///< Solutions of run(), in the order of series.
+    int threads = 1; ///< Number of threads used by run().
+    bool lean = false; ///< Whether each SLS computes segment errors on demand.
+    bool prune = false; ///< Whether each SLS prunes its DP.
+
+    bool load(const char*);
+    bool save(const char*) const;
+    void run();
+    bool write(const char*) const;
 };
@@ -0,0 +1,317 @@
+#include "sls.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Constructor.
+ * @param[in] os indicates where the segments are written, one per line as
+ * "m c start stop" like SLS::compute(), from the first segment to the last.
+ * @param[in] multiplier indicates the cost multiplier C.
+ */
+Stream::Stream(std::ostream& os, double multiplier) : out(os)
+{
+    C = multiplier;
+}
+
+/**
+ * Adds a node to the tree.
+ * @param[in] t indicates the number of points in the prefix.
+ * @param[in] parent indicates the node of the prefix before the last segment, or -1.
+ * @param[in] dp indicates the minimum penalty of the prefix, less base.
+ * @return index of the node, which is neither held nor has kids yet.
+ */
+int Stream::make(long long t, int parent, double dp)
+{
+    int id;
+    if (not unused.empty())
+        id = unused.back(), unused.pop_back();
+    else
+        id = int(nodes.size()), nodes.emplace_back();
+    Node& node = nodes[id];
+    node.t = t, node.parent = parent, node.kids = 0, node.held = 0, node.dp = dp;
+    if (parent >= 0)
+        nodes[parent].kids++;
+    return id;
+}
+
+/**
+ * Drops a reference to a node, freeing it and then any ancestor that is
+ * no longer referred to.
+ * @param[in] id indicates the node.
+ * @param[in] held indicates whether the reference is from a candidate or
+ * last rather than from a kid.
+ */
+void Stream::release(int id, bool held)
+{
+    held ? nodes[id].held-- : nodes[id].kids--;
+    while (id >= 0 and nodes[id].held + nodes[id].kids == 0)
+    {
+        int parent = nodes[id].parent;
+        unused.push_back(id);
+        if (parent >= 0)
+            nodes[parent].kids--;
+        id = parent;
+    }
+}
+
+/**
+ * Computes the least squares error and best fit line of a segment from
+ * its sums, as SLS::lse() does from the prefix sums.
+ * @param[in] c indicates the candidate starting the segment.
+ * @param[in] x indicates the x-coordinate of the last point of the segment.
+ * @param[out] error receives the least squares error of the segment.
+ * @return the best fit line of the segment.
+ */
+Line Stream::fit(const Candidate& c, double x, double& error) const
+{
+    double k = c.k;
+    double xx = c.sxx - c.sx*c.sx/k;
+    double xy = c.sxy - c.sx*c.sy/k;
+    double yy = c.syy - c.sy*c.sy/k;
+    double m = inf, b = c.sx/k + c.x0;
+    error = std::max(xx, 0.0);
+    if (c.x0 != x)
+    {
+        m = xy / xx;
+        b = (c.sy - m*c.sx) / k + c.y0 - m*c.x0;
+        error = yy - m*xy;
+    }
+    if (error < 0.000001) error = 0;
+    return Line(m, b);
+}
+
+/**
+ * Writes the last segment of a node.
+ * @param[in] id indicates the node.
+ */
+void Stream::write(int id)
+{
+    const Node& node = nodes[id];
+    out << node.line.m << ' ' << node.line.c << ' ' << node.start << ' ' << node.stop << '\n';
+    segments++;
+}
+
+/**
+ * Writes every segment that can no longer change. The segment after root
+ * is final once root has a single kid and no candidate starts right after
+ * it, since every later split then goes through that kid. The kid is found
+ * on the path up from last, which every later split also goes through.
+ * The penalty of the written prefix is then moved into base, so that dp
+ * stays small next to the errors it is compared with.
+ */
+void Stream::settle()
+{
+    if (nodes[root].kids != 1 or nodes[root].held != 0)
+        return;
+    std::vector<int> path;
+    for(int id = last; id >= 0 and id != root; id = nodes[id].parent)
+        path.push_back(id);
+    if (path.empty() or nodes[path.back()].parent != root)
+        return;
+    int top = root;
+    while (not path.empty() and nodes[top].kids == 1 and nodes[top].held == 0)
+    {
+        int kid = path.back();
+        path.pop_back();
+        write(kid);
+        nodes[kid].parent = -1, nodes[top].kids--;
+        unused.push_back(top);
+        top = kid;
+    }
+    root = top;
+    double shift = nodes[root].dp;
+    base += shift;
+    for(Node& node : nodes)
+        node.dp -= shift;
+}
+
+/**
+ * Drops every candidate but the newest two, so that the segmentation
+ * must start a segment at one of the last three points (the two kept and
+ * the next). Any segmentation can be made to do so at a cost of at most C:
+ * a segment spanning all three, which has a point on either side of them,
+ * can be split after its first point among them, leaving at least two
+ * points on each side and adding C but no error. So each cut costs at
+ * most C over the optimum.
+ */
+void Stream::cut()
+{
+    PROFILE_SCOPE("stream cut");
+    int k = 0;
+    for(Candidate& c : cands)
+    {
+        if (nodes[c.node].t < points - 2)
+            release(c.node, true);
+        else
+            cands[k++] = c;
+    }
+    cands.resize(k);
+    cuts++;
+}
+
+/**
+ * Ends the segmentation at the newest point and starts a new one after
+ * it, dropping every candidate and node; used when the tree alone is over
+ * cap. The prefix ends either with its best split or with the newest point
+ * alone after the best split of the prefix before it, and the next
+ * segment may also be a single point. Any segmentation of the whole
+ * stream can be cut there by splitting the segment across the cut in two,
+ * which adds C and no error, so this too costs at most C over the optimum,
+ * though the result may then have single-point segments next to the cut.
+ * @param[in] prev indicates the node of the stream without its newest point.
+ */
+void Stream::restart(int prev)
+{
+    PROFILE_SCOPE("stream restart");
+    int end = last;
+    if (nodes[prev].dp + C < nodes[last].dp)
+    {
+        end = make(points, prev, nodes[prev].dp + C);
+        nodes[end].line = Line(inf, px), nodes[end].start = py, nodes[end].stop = py;
+    }
+    std::vector<int> path;
+    for(int id = end; id >= 0 and id != root; id = nodes[id].parent)
+        path.push_back(id);
+    for(auto it = path.rbegin(); it != path.rend(); ++it)
+        write(*it);
+    base += nodes[end].dp;
+    cands.clear(), nodes.clear(), unused.clear();
+    root = last = make(points, -1, 0);
+    nodes[last].held++;
+    single = true;
+    restarts++;
+}
+
+/**
+ * Adds the next point of the stream and writes the segments that became
+ * final. Takes O(k) for k live candidates.
+ * @param[in] x indicates the x-coordinate of the point.
+ * @param[in] y indicates the y-coordinate of the point.
+ * @return whether the point was taken; a point that comes before the
+ * previous one is rejected, and one equal to it is dropped like a duplicate.
+ */
+bool Stream::push(double x, double y)
+{
+    if (points > 0)
+    {
+        if (x < px or (x == px and y < py))
+            return rejected++, false;
+        if (x == px and y == py)
+            return true;
+    }
+    else
+    {
+        root = last = make(0, -1, 0);
+        nodes[last].held++;
+    }
+    px = x, py = y;
+    long long j = ++points;
+
+    // The point can start a segment after the split of the stream before it.
+    if (nodes[last].dp < inf)
+    {
+        Candidate c;
+        c.node = last, c.dead = -1, c.reach = 0, c.x0 = x, c.y0 = y;
+        c.k = c.sx = c.sy = c.sxx = c.sxy = c.syy = 0;
+        cands.push_back(c);
+        nodes[last].held++;
+    }
+
+    double val = inf;
+    int best = -1, k = 0;
+    for(int i = 0; i < int(cands.size()); ++i)
+    {
+        Candidate c = cands[i];
+        if (c.dead >= 0 and c.dead <= j-2)
+        {
+            release(c.node, true);
+            continue;
+        }
+        double dx = x - c.x0, dy = y - c.y0;
+        c.k += 1, c.sx += dx, c.sy += dy;
+        c.sxx += dx*dx, c.sxy += dx*dy, c.syy += dy*dy;
+        if (c.k >= 2)
+        {
+            double e;
+            fit(c, x, e);
+            double dp = nodes[c.node].dp;
+            if (e + C + dp < val)
+                val = e + C + dp, best = k;
+            c.reach = e + dp;
+        }
+        cands[k++] = c;
+    }
+    cands.resize(k);
+
+    int prev = last, next = -1;
+    if (best >= 0)
+    {
+        const Candidate& c = cands[best];
+        next = make(j, c.node, val);
+        double e;
+        Node& node = nodes[next];
+        node.line = fit(c, x, e);
+        node.start = c.x0, node.stop = x;
+        if (node.line.m == inf) node.start = c.y0, node.stop = y;
+    }
+    else if (single)
+    {
+        next = make(j, prev, nodes[prev].dp + C);
+        nodes[next].line = Line(inf, x), nodes[next].start = y, nodes[next].stop = y;
+    }
+    else
+        next = make(j, -1, inf);
+    single = false;
+    last = next;
+    nodes[last].held++;
+
+    double margin = 1e-9 * (std::abs(val) + 1);
+    for(Candidate& c : cands)
+        if (c.k >= 2 and c.dead < 0 and c.reach > val + margin)
+            c.dead = j;
+
+    if (cap and size() > cap)
+        cut();
+    if (cap and size() > cap and nodes[prev].dp < inf)
+        return restart(prev), true;
+    release(prev, true);
+    settle();
+    peak = std::max(peak, size());
+    return true;
+}
+
+/**
+ * Writes the segments that are left at the end of the stream.
+ * @return the minimum penalty of the whole stream, or 0 for a single point.
+ */
+double Stream::finish()
+{
+    if (points == 0)
+        return 0;
+    if (nodes[last].dp == inf)
+        return base;
+    std::vector<int> path;
+    for(int id = last; id >= 0 and id != root; id = nodes[id].parent)
+        path.push_back(id);
+    for(auto it = path.rbegin(); it != path.rend(); ++it)
+        write(*it);
+    return base + nodes[last].dp;
+}
+
+/**
+ * @return number of candidates and tree nodes kept at the moment.
+ */
+size_t Stream::size() const
+{
+    return cands.size() + nodes.size() - unused.size();
+}
+
+/**
+ * @return how much the penalty found may exceed the optimum, from the cuts
+ * and restarts made to respect cap.
+ */
+double Stream::bound() const
+{
+    return (cuts + restarts) * C;
+}